@@ -37,7 +37,7 @@ melo_webplayer_enable (void)
   player = melo_webplayer_player_new ();
 
   /* Create youtube browser */
-  youtube_browser = melo_youtube_browser_new ();
+  youtube_browser = melo_youtube_browser_new (player);
 }
 
 static void
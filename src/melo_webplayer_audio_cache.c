@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#define MELO_LOG_TAG "webplayer_audio_cache"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_audio_cache.h"
+#include "melo_webplayer_disk_cache.h"
+
+struct _MeloWebplayerAudioCache {
+  gint ref_count;
+  GMutex mutex;
+
+  MeloWebplayerDiskCache *disk;
+  GHashTable *writers;
+};
+
+struct _MeloWebplayerAudioCacheWriter {
+  MeloWebplayerAudioCache *cache;
+  char *id;
+  char *path;
+  int fd;
+
+  guint64 written;
+  bool failed;
+  bool finished;
+};
+
+MeloWebplayerAudioCache *
+melo_webplayer_audio_cache_new (const char *path, guint64 budget)
+{
+  MeloWebplayerAudioCache *cache;
+  MeloWebplayerDiskCache *disk;
+
+  /* Load index and clean directory */
+  disk = melo_webplayer_disk_cache_new (path, "audio", budget);
+  if (!disk)
+    return NULL;
+
+  /* Allocate cache */
+  cache = g_slice_new0 (MeloWebplayerAudioCache);
+  cache->ref_count = 1;
+  g_mutex_init (&cache->mutex);
+  cache->disk = disk;
+  cache->writers = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return cache;
+}
+
+static void
+melo_webplayer_audio_cache_unref (MeloWebplayerAudioCache *cache)
+{
+  if (!g_atomic_int_dec_and_test (&cache->ref_count))
+    return;
+
+  /* Free cache */
+  melo_webplayer_disk_cache_free (cache->disk);
+  g_hash_table_unref (cache->writers);
+  g_mutex_clear (&cache->mutex);
+  g_slice_free (MeloWebplayerAudioCache, cache);
+}
+
+void
+melo_webplayer_audio_cache_free (MeloWebplayerAudioCache *cache)
+{
+  if (!cache)
+    return;
+
+  /* Save pending index update now */
+  melo_webplayer_disk_cache_flush (cache->disk);
+
+  /* Cache is released when last writer is freed */
+  melo_webplayer_audio_cache_unref (cache);
+}
+
+char *
+melo_webplayer_audio_cache_lookup (
+    MeloWebplayerAudioCache *cache, const char *id)
+{
+  if (!cache)
+    return NULL;
+
+  return melo_webplayer_disk_cache_lookup (cache->disk, id);
+}
+
+MeloWebplayerAudioCacheWriter *
+melo_webplayer_audio_cache_writer_new (
+    MeloWebplayerAudioCache *cache, const char *id)
+{
+  MeloWebplayerAudioCacheWriter *writer;
+  char *path;
+  int fd = -1;
+
+  if (!cache || !id)
+    return NULL;
+  path = melo_webplayer_disk_cache_get_part (cache->disk, id);
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Create file if stream is neither cached nor being recorded */
+  if (!melo_webplayer_disk_cache_contains (cache->disk, id) &&
+      !g_hash_table_contains (cache->writers, id))
+    fd = g_open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+  if (fd < 0) {
+    g_mutex_unlock (&cache->mutex);
+    g_free (path);
+    return NULL;
+  }
+
+  /* Create writer */
+  writer = g_slice_new0 (MeloWebplayerAudioCacheWriter);
+  writer->cache = cache;
+  writer->id = g_strdup (id);
+  writer->path = path;
+  writer->fd = fd;
+  g_hash_table_add (cache->writers, writer->id);
+  g_atomic_int_inc (&cache->ref_count);
+
+  g_mutex_unlock (&cache->mutex);
+
+  return writer;
+}
+
+bool
+melo_webplayer_audio_cache_writer_write (MeloWebplayerAudioCacheWriter *writer,
+    guint64 offset, const void *data, gsize size)
+{
+  const char *buf = data;
+
+  if (!writer || writer->failed || writer->finished)
+    return false;
+
+  /* Skip data already written */
+  if (offset != (guint64) -1 && offset != writer->written) {
+    if (offset > writer->written) {
+      MELO_LOGD ("gap in %s stream: recording aborted", writer->id);
+      writer->failed = true;
+      return false;
+    }
+    if (offset + size <= writer->written)
+      return true;
+    buf += writer->written - offset;
+    size -= writer->written - offset;
+  }
+
+  /* Stream is larger than the whole cache */
+  if (writer->written + size >
+      melo_webplayer_disk_cache_get_budget (writer->cache->disk)) {
+    writer->failed = true;
+    return false;
+  }
+
+  /* Write chunk */
+  while (size) {
+    ssize_t len = write (writer->fd, buf, size);
+
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      MELO_LOGW ("failed to record %s: %s", writer->id, strerror (errno));
+      writer->failed = true;
+      return false;
+    }
+    writer->written += len;
+    buf += len;
+    size -= len;
+  }
+
+  return true;
+}
+
+void
+melo_webplayer_audio_cache_writer_finish (
+    MeloWebplayerAudioCacheWriter *writer, gint64 size)
+{
+  if (!writer || writer->finished)
+    return;
+
+  /* Check stream is complete */
+  if (writer->failed || !writer->written ||
+      (size >= 0 && (guint64) size != writer->written)) {
+    MELO_LOGD ("incomplete %s stream: recording discarded", writer->id);
+    writer->failed = true;
+    return;
+  }
+
+  /* Flush file to disk */
+  if (fsync (writer->fd)) {
+    MELO_LOGW ("failed to flush %s stream: %s", writer->id, strerror (errno));
+    writer->failed = true;
+    return;
+  }
+  close (writer->fd);
+  writer->fd = -1;
+  writer->finished = true;
+
+  /* Add file to cache and save index now */
+  if (!melo_webplayer_disk_cache_add (
+          writer->cache->disk, writer->id, writer->written, true))
+    return;
+
+  MELO_LOGI ("%s stream saved in audio cache (%" G_GUINT64_FORMAT " bytes)",
+      writer->id, writer->written);
+}
+
+void
+melo_webplayer_audio_cache_writer_free (MeloWebplayerAudioCacheWriter *writer)
+{
+  MeloWebplayerAudioCache *cache;
+
+  if (!writer)
+    return;
+  cache = writer->cache;
+
+  /* Discard unfinished recording */
+  if (!writer->finished) {
+    if (writer->fd >= 0)
+      close (writer->fd);
+    g_unlink (writer->path);
+  }
+
+  /* Release ID */
+  g_mutex_lock (&cache->mutex);
+  g_hash_table_remove (cache->writers, writer->id);
+  g_mutex_unlock (&cache->mutex);
+
+  /* Free writer */
+  g_free (writer->path);
+  g_free (writer->id);
+  g_slice_free (MeloWebplayerAudioCacheWriter, writer);
+
+  melo_webplayer_audio_cache_unref (cache);
+}
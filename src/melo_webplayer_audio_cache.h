@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_AUDIO_CACHE_H_
+#define _MELO_WEBPLAYER_AUDIO_CACHE_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MeloWebplayerAudioCache MeloWebplayerAudioCache;
+typedef struct _MeloWebplayerAudioCacheWriter MeloWebplayerAudioCacheWriter;
+
+/**
+ * Create a new audio cache.
+ *
+ * The cache stores the compressed audio stream of a video in a file of the
+ * @path directory. When the total size of the files exceeds @budget, the least
+ * recently played files are removed. The list of files is kept in an index
+ * file which is always replaced atomically: on creation, the files which are
+ * not listed or not complete are removed.
+ *
+ * @param path the cache directory
+ * @param budget the maximum size of the cache (in bytes)
+ * @return the newly audio cache or NULL.
+ */
+MeloWebplayerAudioCache *melo_webplayer_audio_cache_new (
+    const char *path, guint64 budget);
+void melo_webplayer_audio_cache_free (MeloWebplayerAudioCache *cache);
+
+/**
+ * Lookup for a cached audio stream.
+ *
+ * @param cache the audio cache
+ * @param id the canonical video ID
+ * @return a newly-allocated string with the path of the audio file, or NULL.
+ */
+char *melo_webplayer_audio_cache_lookup (
+    MeloWebplayerAudioCache *cache, const char *id);
+
+/**
+ * Start recording of an audio stream.
+ *
+ * Only one writer can exist for an ID, and no writer is created when the
+ * stream is already in cache.
+ *
+ * @param cache the audio cache
+ * @param id the canonical video ID
+ * @return a new writer to free with melo_webplayer_audio_cache_writer_free(),
+ *     or NULL.
+ */
+MeloWebplayerAudioCacheWriter *melo_webplayer_audio_cache_writer_new (
+    MeloWebplayerAudioCache *cache, const char *id);
+
+/**
+ * Write a chunk of the audio stream.
+ *
+ * The chunks must be contiguous: a chunk already written is skipped and a
+ * gap in the stream makes the recording fail.
+ *
+ * @param writer the writer
+ * @param offset the offset of the chunk in the stream, or -1 to append
+ * @param data the chunk data
+ * @param size the chunk size
+ * @return %false if the recording failed, %true otherwise.
+ */
+bool melo_webplayer_audio_cache_writer_write (
+    MeloWebplayerAudioCacheWriter *writer, guint64 offset, const void *data,
+    gsize size);
+
+/**
+ * Finish recording of an audio stream.
+ *
+ * The file is added to cache only if the recording is complete.
+ *
+ * @param writer the writer
+ * @param size the stream size, or -1 if unknown
+ */
+void melo_webplayer_audio_cache_writer_finish (
+    MeloWebplayerAudioCacheWriter *writer, gint64 size);
+
+/**
+ * Free a writer: if the recording is not finished, it is discarded.
+ *
+ * @param writer the writer
+ */
+void melo_webplayer_audio_cache_writer_free (
+    MeloWebplayerAudioCacheWriter *writer);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_AUDIO_CACHE_H_ */
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+
+#define MELO_LOG_TAG "webplayer_cover_cache"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_cover_cache.h"
+#include "melo_webplayer_disk_cache.h"
+
+#define MELO_WEBPLAYER_COVER_CACHE_USER_AGENT "Melo "
+
+struct _MeloWebplayerCoverCache {
+  MeloWebplayerDiskCache *disk;
+
+  SoupSession *session;
+  GCancellable *cancellable;
+  GHashTable *fetches;
+};
+
+typedef struct {
+  MeloWebplayerCoverCache *cache;
+  GCancellable *cancellable;
+  SoupMessage *msg;
+  char *id;
+  char *path;
+} MeloWebplayerCoverCacheFetch;
+
+MeloWebplayerCoverCache *
+melo_webplayer_cover_cache_new (const char *path, guint64 budget)
+{
+  MeloWebplayerCoverCache *cache;
+  MeloWebplayerDiskCache *disk;
+
+  /* Load index and clean directory */
+  disk = melo_webplayer_disk_cache_new (path, "cover", budget);
+  if (!disk)
+    return NULL;
+
+  /* Allocate cache */
+  cache = g_slice_new0 (MeloWebplayerCoverCache);
+  cache->disk = disk;
+  cache->fetches = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Create HTTP session */
+  cache->session = soup_session_new_with_options (
+      SOUP_SESSION_USER_AGENT, MELO_WEBPLAYER_COVER_CACHE_USER_AGENT, NULL);
+  cache->cancellable = g_cancellable_new ();
+
+  return cache;
+}
+
+void
+melo_webplayer_cover_cache_free (MeloWebplayerCoverCache *cache)
+{
+  MeloWebplayerCoverCacheFetch *fetch;
+  GHashTableIter iter;
+
+  if (!cache)
+    return;
+
+  /* Abort downloads: they are released once cancelled */
+  g_cancellable_cancel (cache->cancellable);
+  g_hash_table_iter_init (&iter, cache->fetches);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &fetch))
+    fetch->cache = NULL;
+  g_hash_table_unref (cache->fetches);
+
+  /* Free cache and save pending index update */
+  g_object_unref (cache->cancellable);
+  g_object_unref (cache->session);
+  melo_webplayer_disk_cache_free (cache->disk);
+  g_slice_free (MeloWebplayerCoverCache, cache);
+}
+
+char *
+melo_webplayer_cover_cache_lookup (
+    MeloWebplayerCoverCache *cache, const char *id)
+{
+  if (!cache)
+    return NULL;
+
+  return melo_webplayer_disk_cache_lookup (cache->disk, id);
+}
+
+static void
+melo_webplayer_cover_cache_fetch_free (MeloWebplayerCoverCacheFetch *fetch)
+{
+  /* Release ID */
+  if (fetch->cache)
+    g_hash_table_remove (fetch->cache->fetches, fetch->id);
+
+  /* Free download */
+  if (fetch->msg)
+    g_object_unref (fetch->msg);
+  g_object_unref (fetch->cancellable);
+  g_free (fetch->path);
+  g_free (fetch->id);
+  g_slice_free (MeloWebplayerCoverCacheFetch, fetch);
+}
+
+static void
+splice_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GOutputStream *stream = G_OUTPUT_STREAM (source_object);
+  MeloWebplayerCoverCacheFetch *fetch = user_data;
+  MeloWebplayerCoverCache *cache = fetch->cache;
+  GError *error = NULL;
+  gssize size;
+
+  /* Download finished */
+  size = g_output_stream_splice_finish (stream, res, &error);
+  g_object_unref (stream);
+  if (!cache || size <= 0 ||
+      (guint64) size > melo_webplayer_disk_cache_get_budget (cache->disk)) {
+    if (error && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      MELO_LOGW ("failed to save cover %s: %s", fetch->id, error->message);
+    g_clear_error (&error);
+    g_unlink (fetch->path);
+    melo_webplayer_cover_cache_fetch_free (fetch);
+    return;
+  }
+
+  /* Add file to cache: covers are downloaded while scrolling, so index
+   * updates are batched
+   */
+  if (melo_webplayer_disk_cache_add (cache->disk, fetch->id, size, false))
+    MELO_LOGD ("cover %s saved (%zd bytes)", fetch->id, size);
+
+  melo_webplayer_cover_cache_fetch_free (fetch);
+}
+
+static void
+send_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  MeloWebplayerCoverCacheFetch *fetch = user_data;
+  GFileOutputStream *output;
+  GInputStream *stream;
+  GError *error = NULL;
+  GFile *file;
+
+  /* Get response body as a stream */
+  stream = soup_session_send_finish (SOUP_SESSION (source_object), res, &error);
+  if (!stream || !fetch->cache || fetch->msg->status_code != SOUP_STATUS_OK) {
+    if (stream)
+      g_object_unref (stream);
+    else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      MELO_LOGD ("failed to download cover %s: %s", fetch->id,
+          error ? error->message : "");
+    g_clear_error (&error);
+    melo_webplayer_cover_cache_fetch_free (fetch);
+    return;
+  }
+
+  /* Open temporary file */
+  file = g_file_new_for_path (fetch->path);
+  output = g_file_replace (
+      file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, NULL, &error);
+  g_object_unref (file);
+  if (!output) {
+    MELO_LOGW ("failed to save cover %s: %s", fetch->id, error->message);
+    melo_webplayer_cover_cache_fetch_free (fetch);
+    g_object_unref (stream);
+    g_error_free (error);
+    return;
+  }
+
+  /* Write body as it is received */
+  g_output_stream_splice_async (G_OUTPUT_STREAM (output), stream,
+      G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+      G_PRIORITY_LOW, fetch->cancellable, splice_cb, fetch);
+  g_object_unref (stream);
+}
+
+static bool
+melo_webplayer_cover_cache_check_id (const char *id)
+{
+  const char *p;
+
+  /* Asset ID is used in URL: keep only safe characters */
+  if (!id || *id == '\0' || *id == '/' || strstr (id, ".."))
+    return false;
+  for (p = id; *p != '\0'; p++)
+    if (!g_ascii_isalnum (*p) && !strchr ("-_./", *p))
+      return false;
+
+  return true;
+}
+
+void
+melo_webplayer_cover_cache_fetch (
+    MeloWebplayerCoverCache *cache, const char *id, const char *url)
+{
+  MeloWebplayerCoverCacheFetch *fetch;
+  SoupMessage *msg;
+
+  if (!cache || !url || !melo_webplayer_cover_cache_check_id (id))
+    return;
+
+  /* Cover is already cached or being downloaded */
+  if (melo_webplayer_disk_cache_contains (cache->disk, id) ||
+      g_hash_table_contains (cache->fetches, id))
+    return;
+
+  /* Create request */
+  msg = soup_message_new ("GET", url);
+  if (!msg)
+    return;
+
+  /* Create download */
+  fetch = g_slice_new0 (MeloWebplayerCoverCacheFetch);
+  fetch->cache = cache;
+  fetch->cancellable = g_object_ref (cache->cancellable);
+  fetch->msg = msg;
+  fetch->id = g_strdup (id);
+  fetch->path = melo_webplayer_disk_cache_get_part (cache->disk, id);
+  g_hash_table_insert (cache->fetches, fetch->id, fetch);
+
+  /* Send request: body is not buffered */
+  soup_session_send_async (
+      cache->session, msg, fetch->cancellable, send_cb, fetch);
+}
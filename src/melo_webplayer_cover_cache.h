@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#ifndef _MELO_WEBPLAYER_COVER_CACHE_H_
+#define _MELO_WEBPLAYER_COVER_CACHE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MeloWebplayerCoverCache MeloWebplayerCoverCache;
+
+/**
+ * Create a new cover cache.
+ *
+ * The cache stores the thumbnails of videos in files of the @path directory.
+ * When the total size of the files exceeds @budget, the least recently used
+ * files are removed. As for the audio cache, the list of files is kept in an
+ * index file which is always replaced atomically.
+ *
+ * The cache must be used from the main loop only.
+ *
+ * @param path the cache directory
+ * @param budget the maximum size of the cache (in bytes)
+ * @return the newly cover cache or NULL.
+ */
+MeloWebplayerCoverCache *melo_webplayer_cover_cache_new (
+    const char *path, guint64 budget);
+void melo_webplayer_cover_cache_free (MeloWebplayerCoverCache *cache);
+
+/**
+ * Lookup for a cached cover.
+ *
+ * @param cache the cover cache
+ * @param id the asset ID of the cover
+ * @return a newly-allocated string with the path of the cover file, or NULL.
+ */
+char *melo_webplayer_cover_cache_lookup (
+    MeloWebplayerCoverCache *cache, const char *id);
+
+/**
+ * Download a cover in background and add it to cache.
+ *
+ * Nothing is done if the cover is already cached or being downloaded.
+ *
+ * @param cache the cover cache
+ * @param id the asset ID of the cover
+ * @param url the URL of the cover
+ */
+void melo_webplayer_cover_cache_fetch (
+    MeloWebplayerCoverCache *cache, const char *id, const char *url);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_COVER_CACHE_H_ */
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#define MELO_LOG_TAG "webplayer_disk_cache"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_disk_cache.h"
+
+#define MELO_WEBPLAYER_DISK_CACHE_INDEX "index"
+#define MELO_WEBPLAYER_DISK_CACHE_PART ".part"
+
+/* Delay before index is saved after a lookup (in seconds) */
+#define MELO_WEBPLAYER_DISK_CACHE_SAVE_DELAY 10
+
+typedef struct {
+  char *id;
+  char *name;
+  guint64 size;
+} MeloWebplayerDiskCacheEntry;
+
+struct _MeloWebplayerDiskCache {
+  GMutex mutex;
+
+  char *path;
+  char *name;
+  guint64 budget;
+  guint64 size;
+
+  GHashTable *table;
+  GQueue list;
+  guint save_id;
+};
+
+static void
+melo_webplayer_disk_cache_entry_free (MeloWebplayerDiskCacheEntry *entry)
+{
+  g_free (entry->id);
+  g_free (entry->name);
+  g_slice_free (MeloWebplayerDiskCacheEntry, entry);
+}
+
+static void
+melo_webplayer_disk_cache_save (MeloWebplayerDiskCache *cache)
+{
+  GError *error = NULL;
+  GString *str;
+  char *path;
+  GList *l;
+
+  /* Generate index: one file per line, most recently used first */
+  str = g_string_new (NULL);
+  for (l = cache->list.head; l != NULL; l = l->next) {
+    MeloWebplayerDiskCacheEntry *entry = l->data;
+
+    g_string_append_printf (str, "%s %" G_GUINT64_FORMAT " %s\n", entry->name,
+        entry->size, entry->id);
+  }
+
+  /* Replace index atomically */
+  path = g_build_filename (cache->path, MELO_WEBPLAYER_DISK_CACHE_INDEX, NULL);
+  if (!g_file_set_contents (path, str->str, str->len, &error)) {
+    MELO_LOGW ("failed to save %s cache index: %s", cache->name,
+        error->message);
+    g_error_free (error);
+  }
+  g_string_free (str, TRUE);
+  g_free (path);
+}
+
+static gboolean
+save_cb (gpointer user_data)
+{
+  MeloWebplayerDiskCache *cache = user_data;
+
+  g_mutex_lock (&cache->mutex);
+  cache->save_id = 0;
+  melo_webplayer_disk_cache_save (cache);
+  g_mutex_unlock (&cache->mutex);
+
+  return FALSE;
+}
+
+static void
+melo_webplayer_disk_cache_schedule_save (MeloWebplayerDiskCache *cache)
+{
+  /* Batch index updates */
+  if (!cache->save_id)
+    cache->save_id = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+        MELO_WEBPLAYER_DISK_CACHE_SAVE_DELAY, save_cb, cache, NULL);
+}
+
+static void
+melo_webplayer_disk_cache_evict (MeloWebplayerDiskCache *cache)
+{
+  /* Remove least recently used files */
+  while (cache->size > cache->budget && cache->list.tail) {
+    MeloWebplayerDiskCacheEntry *entry = g_queue_pop_tail (&cache->list);
+    char *path;
+
+    MELO_LOGD ("evict %s from %s cache", entry->id, cache->name);
+
+    path = g_build_filename (cache->path, entry->name, NULL);
+    g_unlink (path);
+    g_free (path);
+
+    g_hash_table_remove (cache->table, entry->id);
+    cache->size -= entry->size;
+    melo_webplayer_disk_cache_entry_free (entry);
+  }
+}
+
+static void
+melo_webplayer_disk_cache_load (MeloWebplayerDiskCache *cache)
+{
+  GHashTable *names;
+  const char *name;
+  char *data, *line, *next, *path;
+  GDir *dir;
+
+  /* Read index */
+  path = g_build_filename (cache->path, MELO_WEBPLAYER_DISK_CACHE_INDEX, NULL);
+  if (!g_file_get_contents (path, &data, NULL, NULL))
+    data = NULL;
+  g_free (path);
+
+  /* Parse lines */
+  names = g_hash_table_new (g_str_hash, g_str_equal);
+  for (line = data; line && *line != '\0'; line = next) {
+    MeloWebplayerDiskCacheEntry *entry;
+    GStatBuf st;
+    char **fields;
+
+    /* Split line */
+    next = strchr (line, '\n');
+    if (next)
+      *next++ = '\0';
+
+    /* Parse fields: file name, size and ID */
+    fields = g_strsplit (line, " ", 3);
+    if (g_strv_length (fields) != 3 ||
+        g_hash_table_contains (cache->table, fields[2])) {
+      g_strfreev (fields);
+      continue;
+    }
+
+    /* Create entry */
+    entry = g_slice_new (MeloWebplayerDiskCacheEntry);
+    entry->name = g_strdup (fields[0]);
+    entry->size = g_ascii_strtoull (fields[1], NULL, 10);
+    entry->id = g_strdup (fields[2]);
+    g_strfreev (fields);
+
+    /* Drop missing or truncated files */
+    path = g_build_filename (cache->path, entry->name, NULL);
+    if (g_stat (path, &st) || (guint64) st.st_size != entry->size) {
+      melo_webplayer_disk_cache_entry_free (entry);
+      g_free (path);
+      continue;
+    }
+    g_free (path);
+
+    /* Add to list */
+    g_queue_push_tail (&cache->list, entry);
+    g_hash_table_insert (cache->table, entry->id, cache->list.tail);
+    g_hash_table_add (names, entry->name);
+    cache->size += entry->size;
+  }
+  g_free (data);
+
+  /* Remove unknown files and unfinished ones */
+  dir = g_dir_open (cache->path, 0, NULL);
+  while (dir && (name = g_dir_read_name (dir)) != NULL) {
+    if (!strcmp (name, MELO_WEBPLAYER_DISK_CACHE_INDEX) ||
+        g_hash_table_contains (names, name))
+      continue;
+
+    path = g_build_filename (cache->path, name, NULL);
+    g_unlink (path);
+    g_free (path);
+  }
+  if (dir)
+    g_dir_close (dir);
+  g_hash_table_unref (names);
+
+  /* Apply budget */
+  melo_webplayer_disk_cache_evict (cache);
+  melo_webplayer_disk_cache_save (cache);
+
+  MELO_LOGD ("%u files loaded in %s cache (%" G_GUINT64_FORMAT " bytes)",
+      cache->list.length, cache->name, cache->size);
+}
+
+MeloWebplayerDiskCache *
+melo_webplayer_disk_cache_new (
+    const char *path, const char *name, guint64 budget)
+{
+  MeloWebplayerDiskCache *cache;
+
+  if (!path || !budget || g_mkdir_with_parents (path, 0700))
+    return NULL;
+
+  /* Allocate cache */
+  cache = g_slice_new0 (MeloWebplayerDiskCache);
+  g_mutex_init (&cache->mutex);
+  g_queue_init (&cache->list);
+  cache->table = g_hash_table_new (g_str_hash, g_str_equal);
+  cache->path = g_strdup (path);
+  cache->name = g_strdup (name);
+  cache->budget = budget;
+
+  /* Load index and clean directory */
+  melo_webplayer_disk_cache_load (cache);
+
+  return cache;
+}
+
+void
+melo_webplayer_disk_cache_free (MeloWebplayerDiskCache *cache)
+{
+  if (!cache)
+    return;
+
+  /* Save pending index update */
+  melo_webplayer_disk_cache_flush (cache);
+
+  /* Free entries */
+  g_hash_table_unref (cache->table);
+  g_queue_clear_full (
+      &cache->list, (GDestroyNotify) melo_webplayer_disk_cache_entry_free);
+
+  /* Free cache */
+  g_mutex_clear (&cache->mutex);
+  g_free (cache->name);
+  g_free (cache->path);
+  g_slice_free (MeloWebplayerDiskCache, cache);
+}
+
+void
+melo_webplayer_disk_cache_flush (MeloWebplayerDiskCache *cache)
+{
+  guint id;
+
+  if (!cache)
+    return;
+
+  /* Save pending index update now */
+  g_mutex_lock (&cache->mutex);
+  id = cache->save_id;
+  cache->save_id = 0;
+  if (id)
+    melo_webplayer_disk_cache_save (cache);
+  g_mutex_unlock (&cache->mutex);
+  if (id)
+    g_source_remove (id);
+}
+
+guint64
+melo_webplayer_disk_cache_get_budget (MeloWebplayerDiskCache *cache)
+{
+  return cache->budget;
+}
+
+bool
+melo_webplayer_disk_cache_contains (
+    MeloWebplayerDiskCache *cache, const char *id)
+{
+  bool ret;
+
+  g_mutex_lock (&cache->mutex);
+  ret = g_hash_table_contains (cache->table, id);
+  g_mutex_unlock (&cache->mutex);
+
+  return ret;
+}
+
+char *
+melo_webplayer_disk_cache_lookup (
+    MeloWebplayerDiskCache *cache, const char *id)
+{
+  char *path = NULL;
+  GList *link;
+
+  if (!cache || !id)
+    return NULL;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Find entry */
+  link = g_hash_table_lookup (cache->table, id);
+  if (link) {
+    MeloWebplayerDiskCacheEntry *entry = link->data;
+
+    /* Move to head of list */
+    if (link != cache->list.head) {
+      g_queue_unlink (&cache->list, link);
+      g_queue_push_head_link (&cache->list, link);
+      melo_webplayer_disk_cache_schedule_save (cache);
+    }
+
+    /* Get file path */
+    path = g_build_filename (cache->path, entry->name, NULL);
+  }
+
+  g_mutex_unlock (&cache->mutex);
+
+  return path;
+}
+
+char *
+melo_webplayer_disk_cache_get_part (
+    MeloWebplayerDiskCache *cache, const char *id)
+{
+  char *name, *path;
+
+  /* File name is derived from ID */
+  name = g_compute_checksum_for_string (G_CHECKSUM_SHA1, id, -1);
+  path = g_strconcat (cache->path, G_DIR_SEPARATOR_S, name,
+      MELO_WEBPLAYER_DISK_CACHE_PART, NULL);
+  g_free (name);
+
+  return path;
+}
+
+bool
+melo_webplayer_disk_cache_add (
+    MeloWebplayerDiskCache *cache, const char *id, guint64 size, bool save)
+{
+  MeloWebplayerDiskCacheEntry *entry;
+  char *name, *part, *path;
+  GList *link;
+
+  /* Rename temporary file */
+  name = g_compute_checksum_for_string (G_CHECKSUM_SHA1, id, -1);
+  part = melo_webplayer_disk_cache_get_part (cache, id);
+  path = g_build_filename (cache->path, name, NULL);
+  if (g_rename (part, path)) {
+    MELO_LOGW ("failed to save %s in %s cache: %s", id, cache->name,
+        g_strerror (errno));
+    g_unlink (part);
+    g_free (path);
+    g_free (part);
+    g_free (name);
+    return false;
+  }
+  g_free (path);
+  g_free (part);
+
+  /* Create entry */
+  entry = g_slice_new (MeloWebplayerDiskCacheEntry);
+  entry->id = g_strdup (id);
+  entry->name = name;
+  entry->size = size;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Replace previous file */
+  link = g_hash_table_lookup (cache->table, id);
+  if (link) {
+    MeloWebplayerDiskCacheEntry *old = link->data;
+
+    g_hash_table_remove (cache->table, id);
+    g_queue_delete_link (&cache->list, link);
+    cache->size -= old->size;
+    melo_webplayer_disk_cache_entry_free (old);
+  }
+
+  /* Add to head of list */
+  g_queue_push_head (&cache->list, entry);
+  g_hash_table_insert (cache->table, entry->id, cache->list.head);
+  cache->size += entry->size;
+
+  /* Apply budget and save index */
+  melo_webplayer_disk_cache_evict (cache);
+  if (save)
+    melo_webplayer_disk_cache_save (cache);
+  else
+    melo_webplayer_disk_cache_schedule_save (cache);
+
+  g_mutex_unlock (&cache->mutex);
+
+  return true;
+}
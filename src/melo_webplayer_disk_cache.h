@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_DISK_CACHE_H_
+#define _MELO_WEBPLAYER_DISK_CACHE_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MeloWebplayerDiskCache MeloWebplayerDiskCache;
+
+/**
+ * Create a new disk cache.
+ *
+ * The cache stores one file per ID in the @path directory. When the total size
+ * of the files exceeds @budget, the least recently used files are removed. The
+ * list of files is kept in an index file which is always replaced atomically:
+ * on creation, the files which are not listed or not complete are removed.
+ *
+ * The functions can be called from any thread, but the index updates caused
+ * by lookups are saved from the main loop.
+ *
+ * @param path the cache directory
+ * @param name the cache name, used in logs
+ * @param budget the maximum size of the cache (in bytes)
+ * @return the newly disk cache or NULL.
+ */
+MeloWebplayerDiskCache *melo_webplayer_disk_cache_new (
+    const char *path, const char *name, guint64 budget);
+
+void melo_webplayer_disk_cache_free (MeloWebplayerDiskCache *cache);
+
+/**
+ * Save a pending index update now.
+ *
+ * It must be called from the main loop before the cache is freed from another
+ * thread.
+ *
+ * @param cache the disk cache
+ */
+void melo_webplayer_disk_cache_flush (MeloWebplayerDiskCache *cache);
+
+guint64 melo_webplayer_disk_cache_get_budget (MeloWebplayerDiskCache *cache);
+bool melo_webplayer_disk_cache_contains (
+    MeloWebplayerDiskCache *cache, const char *id);
+
+/**
+ * Lookup for a cached file.
+ *
+ * The file becomes the most recently used one.
+ *
+ * @param cache the disk cache
+ * @param id the file ID
+ * @return a newly-allocated string with the path of the file, or NULL.
+ */
+char *melo_webplayer_disk_cache_lookup (
+    MeloWebplayerDiskCache *cache, const char *id);
+
+/**
+ * Get the path of the temporary file of an ID.
+ *
+ * The temporary file is filled by the caller, then it is added to cache with
+ * melo_webplayer_disk_cache_add(). It is removed on next start otherwise.
+ *
+ * @param cache the disk cache
+ * @param id the file ID
+ * @return a newly-allocated string with the temporary file path.
+ */
+char *melo_webplayer_disk_cache_get_part (
+    MeloWebplayerDiskCache *cache, const char *id);
+
+/**
+ * Add a complete temporary file to cache.
+ *
+ * The least recently used files are removed to respect the budget.
+ *
+ * @param cache the disk cache
+ * @param id the file ID
+ * @param size the file size (in bytes)
+ * @param save %true to save the index now, %false to save it later
+ * @return %true if the file has been added, %false otherwise.
+ */
+bool melo_webplayer_disk_cache_add (
+    MeloWebplayerDiskCache *cache, const char *id, guint64 size, bool save);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_DISK_CACHE_H_ */
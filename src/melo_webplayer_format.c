@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <string.h>
+
+#define MELO_LOG_TAG "webplayer_format"
+#include <melo/melo_log.h>
+
+#include "config.h"
+
+#include "melo_webplayer_format.h"
+
+/* Score bonus of the preferred codec (in kbps) */
+#define MELO_WEBPLAYER_FORMAT_PREFERENCE 64
+
+/* Codec table with relative decoding costs */
+static const MeloWebplayerFormatCodec melo_webplayer_format_codecs[] = {
+    {"mp3", 1},
+    {"mp4a", 2},
+    {"opus", 3},
+    {"vorbis", 3},
+    {NULL, 4},
+};
+
+static const MeloWebplayerFormatPolicy melo_webplayer_format_policy = {
+    .codecs = melo_webplayer_format_codecs,
+    .preferred_codec = MELO_WEBPLAYER_FORMAT_CODEC,
+    .max_bitrate = MELO_WEBPLAYER_FORMAT_MAX_BITRATE,
+    .cost_weight = MELO_WEBPLAYER_FORMAT_COST_WEIGHT,
+    .ban_video = MELO_WEBPLAYER_FORMAT_BAN_VIDEO,
+};
+
+const MeloWebplayerFormatPolicy *
+melo_webplayer_format_get_default_policy (void)
+{
+  return &melo_webplayer_format_policy;
+}
+
+bool
+melo_webplayer_format_has_video (const MeloWebplayerFormat *format)
+{
+  return format->vcodec && strcmp (format->vcodec, "none");
+}
+
+bool
+melo_webplayer_format_score (const MeloWebplayerFormatPolicy *policy,
+    const MeloWebplayerFormat *format, double *score)
+{
+  const MeloWebplayerFormatCodec *codec;
+  double s;
+
+  /* Format must have an URL, an audio track and a known bit-rate */
+  if (!format->url || !format->acodec || !strcmp (format->acodec, "none") ||
+      format->bitrate <= 0)
+    return false;
+
+  /* Video track is downloaded for nothing */
+  if (melo_webplayer_format_has_video (format) && policy->ban_video)
+    return false;
+
+  /* Bit-rate above the limit counts as a penalty */
+  s = format->bitrate;
+  if (policy->max_bitrate && s > policy->max_bitrate)
+    s = 2.0 * policy->max_bitrate - s;
+
+  /* Find codec: the last entry is used for unknown codecs */
+  for (codec = policy->codecs; codec->prefix; codec++)
+    if (g_str_has_prefix (format->acodec, codec->prefix))
+      break;
+  s -= (double) codec->cost * policy->cost_weight;
+
+  /* Preferred codec */
+  if (policy->preferred_codec && *policy->preferred_codec != '\0' &&
+      g_str_has_prefix (format->acodec, policy->preferred_codec))
+    s += MELO_WEBPLAYER_FORMAT_PREFERENCE;
+
+  if (score)
+    *score = s;
+
+  return true;
+}
+
+int
+melo_webplayer_format_select (const MeloWebplayerFormatPolicy *policy,
+    const MeloWebplayerFormat *formats, unsigned int count)
+{
+  double best_score = 0;
+  bool best_video = false;
+  int best = -1;
+  unsigned int i;
+
+  if (!policy)
+    policy = &melo_webplayer_format_policy;
+
+  /* Find format with highest score, audio-only formats first */
+  for (i = 0; i < count; i++) {
+    double score;
+    bool video;
+
+    if (!melo_webplayer_format_score (policy, &formats[i], &score))
+      continue;
+    video = melo_webplayer_format_has_video (&formats[i]);
+
+    if (best < 0 || (best_video && !video) ||
+        (video == best_video && score > best_score)) {
+      best_score = score;
+      best_video = video;
+      best = i;
+    }
+  }
+
+  if (best >= 0)
+    MELO_LOGD ("format selected: %s at %.0f kbps (score %.1f)",
+        formats[best].acodec, formats[best].bitrate, best_score);
+
+  return best;
+}
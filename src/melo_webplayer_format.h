@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_FORMAT_H_
+#define _MELO_WEBPLAYER_FORMAT_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * MeloWebplayerFormat:
+ * @url: the stream URL
+ * @acodec: the audio codec, NULL if the format has no audio
+ * @vcodec: the video codec, NULL if the format has no video
+ * @bitrate: the audio bit-rate (or total bit-rate if unknown) in kbps, 0 if
+ *     unknown
+ *
+ * A format proposed by the grabber for a video.
+ */
+typedef struct {
+  const char *url;
+  const char *acodec;
+  const char *vcodec;
+  double bitrate;
+} MeloWebplayerFormat;
+
+/**
+ * MeloWebplayerFormatCodec:
+ * @prefix: the codec name prefix, NULL for the table end
+ * @cost: the relative decoding cost of the codec
+ *
+ * An entry of the codec table used to score formats. The cost of the last
+ * entry is used for unknown codecs.
+ */
+typedef struct {
+  const char *prefix;
+  unsigned int cost;
+} MeloWebplayerFormatCodec;
+
+/**
+ * MeloWebplayerFormatPolicy:
+ * @codecs: the codec table, terminated by an entry with a NULL prefix
+ * @preferred_codec: the prefix of the codec which gets a score bonus, can be
+ *     NULL
+ * @max_bitrate: the bit-rate above which a format is penalized (in kbps), 0
+ *     for no limit
+ * @cost_weight: the score penalty per decoding cost unit (in kbps)
+ * @ban_video: reject all formats with a video track
+ *
+ * The policy used to select the audio format of a video.
+ */
+typedef struct {
+  const MeloWebplayerFormatCodec *codecs;
+  const char *preferred_codec;
+  unsigned int max_bitrate;
+  unsigned int cost_weight;
+  bool ban_video;
+} MeloWebplayerFormatPolicy;
+
+/**
+ * Get the policy set at build time.
+ *
+ * @return the default policy.
+ */
+const MeloWebplayerFormatPolicy *melo_webplayer_format_get_default_policy (
+    void);
+
+/**
+ * Check if a format has a video track.
+ *
+ * @param format the format to check
+ * @return %true if the format has a video track, %false otherwise.
+ */
+bool melo_webplayer_format_has_video (const MeloWebplayerFormat *format);
+
+/**
+ * Score a format.
+ *
+ * The score is based on the bit-rate, adjusted with the codec preference and
+ * decoding cost. A format without a known bit-rate is rejected.
+ *
+ * @param policy the policy to use
+ * @param format the format to score
+ * @param score a pointer to store the score
+ * @return %true if the format is playable, %false if it is rejected.
+ */
+bool melo_webplayer_format_score (const MeloWebplayerFormatPolicy *policy,
+    const MeloWebplayerFormat *format, double *score);
+
+/**
+ * Select the best format.
+ *
+ * Audio-only formats are always preferred: a format with a video track is
+ * selected only when no audio-only format is playable. Among formats of the
+ * same kind, the first with the highest score is selected.
+ *
+ * @param policy the policy to use
+ * @param formats the formats array
+ * @param count the number of formats
+ * @return the index of the best format, or -1 if all formats are rejected.
+ */
+int melo_webplayer_format_select (const MeloWebplayerFormatPolicy *policy,
+    const MeloWebplayerFormat *formats, unsigned int count);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_FORMAT_H_ */
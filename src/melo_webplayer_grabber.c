@@ -0,0 +1,1961 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <Python.h>
+
+
+#include <glib/gstdio.h>
+
+#define MELO_LOG_TAG "webplayer_grabber"
+#include <melo/melo_log.h>
+
+#include "config.h"
+
+#include "melo_webplayer_format.h"
+#include "melo_webplayer_grabber.h"
+#include "melo_webplayer_helper.h"
+#include "melo_webplayer_route.h"
+#include "melo_webplayer_stats.h"
+
+#define MELO_WEBPLAYER_GRABBER_PATH "output"
+#define MELO_WEBPLAYER_GRABBER_MODULE "yt_dlp"
+#define MELO_WEBPLAYER_GRABBER_CLASS "YoutubeDL"
+
+/* Module attribute holding the grabber version it has been imported from */
+#define MELO_WEBPLAYER_GRABBER_VERSION_ATTR "__melo_version__"
+
+/* Persistent grabber state, in cache directory */
+#define MELO_WEBPLAYER_GRABBER_PYCACHE "pycache"
+#define MELO_WEBPLAYER_GRABBER_CACHE "grabber"
+#define MELO_WEBPLAYER_GRABBER_COOKIES "cookies.txt"
+
+/* Player JS deciphering cache, in grabber cache directory, and module file
+ * rewritten by each update
+ */
+#define MELO_WEBPLAYER_GRABBER_PLAYER_CACHE "youtube-nsig"
+#define MELO_WEBPLAYER_GRABBER_VERSION_FILE "version.py"
+
+/* Extractor and URL used to check a loaded grabber */
+#define MELO_WEBPLAYER_GRABBER_CHECK_IE "Youtube"
+#define MELO_WEBPLAYER_GRABBER_CHECK_URL \
+  "https://www.youtube.com/watch?v=BaW_jenozKc"
+
+/* Extractor of hedged play jobs */
+#define MELO_WEBPLAYER_GRABBER_HEDGE_IE "Youtube"
+
+/* Timeout of grabber network operations (in seconds) */
+#define MELO_WEBPLAYER_GRABBER_SOCKET_TIMEOUT 10
+
+/* Use one interpreter with its own GIL per worker when available, otherwise
+ * all workers share the main interpreter (and its GIL, if any).
+ */
+#if PY_VERSION_HEX >= 0x030C0000 && !defined(Py_GIL_DISABLED)
+#define MELO_WEBPLAYER_GRABBER_SUBINTERPRETER
+#endif
+
+typedef enum {
+  MELO_WEBPLAYER_GRABBER_TASK_NONE = 0,
+  MELO_WEBPLAYER_GRABBER_TASK_LOAD,
+  MELO_WEBPLAYER_GRABBER_TASK_COMPILE,
+} MeloWebplayerGrabberTask;
+
+typedef struct {
+  unsigned int id;
+  MeloWebplayerGrabberPriority priority;
+  MeloWebplayerGrabberCb cb;
+  void *user_data;
+} MeloWebplayerGrabberWaiter;
+
+typedef struct {
+  unsigned int count;
+  bool done;
+  GSList *waiters;
+} MeloWebplayerGrabberHedge;
+
+typedef struct {
+  unsigned int id;
+  MeloWebplayerGrabberPriority priority;
+  char *url;
+  char *id_str;
+  const char *client;
+  gint64 queue_time;
+  gint64 hedge_time;
+  MeloWebplayerGrabberHedge *hedge;
+  GSList *waiters;
+  bool running;
+  bool dropped;
+  bool cancelled;
+  bool preempted;
+} MeloWebplayerGrabberJob;
+
+typedef struct {
+  MeloWebplayerGrabber *grabber;
+  unsigned int index;
+  GThread *thread;
+
+  GMutex lock;
+  MeloWebplayerGrabberJob *job;
+  MeloWebplayerGrabberJob task;
+  unsigned int run;
+  unsigned int abort;
+  unsigned long ident;
+
+  unsigned int load;
+
+  MeloWebplayerHelper *helper;
+  MeloWebplayerHelper *spare;
+  int version;
+
+  PyThreadState *tstate;
+  PyThreadState *main_tstate;
+  PyGILState_STATE gstate;
+
+  PyObject *module;
+  PyObject *instance;
+} MeloWebplayerGrabberWorker;
+
+struct _MeloWebplayerGrabber {
+  char *path;
+  char *cache_path;
+  char *helper;
+  GMutex cookie_mutex;
+
+  GMutex mutex;
+  GCond cond;
+  GQueue queues[MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT];
+  GQueue active;
+  MeloWebplayerGrabberJob *hedge_job;
+  unsigned int job_id;
+  unsigned int idle;
+  unsigned int load;
+  unsigned int loading;
+  bool compile;
+  bool compiling;
+  int version;
+  int prefetched;
+  bool lean;
+  bool start;
+  bool stop;
+
+  bool initialized;
+  bool finalize;
+  PyThreadState *main_tstate;
+
+  MeloWebplayerGrabberWorker *workers;
+  unsigned int count;
+  unsigned int running;
+
+  GThread *abort_thread;
+  GMutex abort_mutex;
+  GCond abort_cond;
+  bool abort_pending;
+  bool abort_stop;
+};
+
+static gpointer melo_webplayer_grabber_thread_func (gpointer user_data);
+static gpointer melo_webplayer_grabber_abort_thread_func (gpointer user_data);
+static void melo_webplayer_grabber_interrupt (MeloWebplayerGrabber *grabber,
+    unsigned int id, MeloWebplayerGrabberPriority priority);
+static void melo_webplayer_grabber_preempt (MeloWebplayerGrabber *grabber);
+
+MeloWebplayerGrabber *
+melo_webplayer_grabber_new (const char *path, const char *cache_path,
+    const char *helper, unsigned int workers)
+{
+  MeloWebplayerGrabber *grabber;
+  unsigned int i;
+
+  /* Allocate grabber */
+  grabber = g_slice_new0 (MeloWebplayerGrabber);
+  grabber->path = g_strdup (path);
+  grabber->cache_path = g_strdup (cache_path);
+  grabber->helper = g_strdup (helper);
+  g_mutex_init (&grabber->cookie_mutex);
+  g_mutex_init (&grabber->mutex);
+  grabber->prefetched = -1;
+  grabber->lean = MELO_WEBPLAYER_GRABBER_LEAN;
+  g_cond_init (&grabber->cond);
+  for (i = 0; i < MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT; i++)
+    g_queue_init (&grabber->queues[i]);
+  g_queue_init (&grabber->active);
+  g_mutex_init (&grabber->abort_mutex);
+  g_cond_init (&grabber->abort_cond);
+
+  /* Create workers */
+  grabber->count = workers ? workers : 1;
+  grabber->running = grabber->count;
+  grabber->workers = g_new0 (MeloWebplayerGrabberWorker, grabber->count);
+  for (i = 0; i < grabber->count; i++) {
+    MeloWebplayerGrabberWorker *worker = &grabber->workers[i];
+
+    /* Start worker thread */
+    worker->grabber = grabber;
+    worker->index = i;
+    g_mutex_init (&worker->lock);
+    worker->thread = g_thread_new (
+        "webplayer_worker", melo_webplayer_grabber_thread_func, worker);
+  }
+
+  /* Start abort thread: helper processes are killed instead */
+  if (!helper)
+    grabber->abort_thread = g_thread_new (
+        "webplayer_abort", melo_webplayer_grabber_abort_thread_func, grabber);
+
+  MELO_LOGI ("%u extraction workers started%s", grabber->count,
+      helper ? " with helper processes" : "");
+
+  return grabber;
+}
+
+static GSList **
+melo_webplayer_grabber_job_waiters (MeloWebplayerGrabberJob *job)
+{
+  /* Waiters of a hedged job are shared by both attempts */
+  return job->hedge ? &job->hedge->waiters : &job->waiters;
+}
+
+static void
+melo_webplayer_grabber_notify (GSList *waiters, MeloWebplayerStream *stream)
+{
+  GSList *l;
+
+  /* No more waiter */
+  if (!waiters)
+    melo_webplayer_stream_free (stream);
+
+  /* Each waiter gets its own stream */
+  for (l = waiters; l != NULL; l = l->next) {
+    MeloWebplayerGrabberWaiter *waiter = l->data;
+    MeloWebplayerStream *s;
+
+    s = l->next && stream ? melo_webplayer_stream_copy (stream) : stream;
+    if (waiter->cb)
+      waiter->cb (s, waiter->user_data);
+    else
+      melo_webplayer_stream_free (s);
+    g_slice_free (MeloWebplayerGrabberWaiter, waiter);
+  }
+  g_slist_free (waiters);
+}
+
+static void
+melo_webplayer_grabber_job_free (MeloWebplayerGrabber *grabber,
+    MeloWebplayerGrabberJob *job, MeloWebplayerStream *stream)
+{
+  MeloWebplayerGrabberHedge *hedge;
+  GSList *waiters = NULL;
+  bool abort = false;
+
+  g_mutex_lock (&grabber->mutex);
+
+  /* Job cannot be hedged anymore */
+  if (grabber->hedge_job == job)
+    grabber->hedge_job = NULL;
+  if (job->running)
+    g_queue_remove (&grabber->active, job);
+
+  /* Hedged job: first stream wins, failure is reported by last attempt */
+  hedge = job->hedge;
+  if (hedge) {
+    hedge->count--;
+    if (!hedge->done && (stream || !hedge->count)) {
+      hedge->done = true;
+      abort = hedge->count;
+      waiters = hedge->waiters;
+      hedge->waiters = NULL;
+      if (stream)
+        MELO_LOGI ("hedged extraction of %s won by %s client", job->id_str,
+            job->client ? job->client : "default");
+    }
+    if (hedge->count)
+      hedge = NULL;
+  } else {
+    waiters = job->waiters;
+    job->waiters = NULL;
+  }
+
+  g_mutex_unlock (&grabber->mutex);
+
+  /* Abort other attempt */
+  if (abort)
+    melo_webplayer_grabber_interrupt (
+        grabber, job->id, MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT);
+
+  /* Notify end of job */
+  melo_webplayer_grabber_notify (waiters, stream);
+
+  /* Free job */
+  if (hedge)
+    g_slice_free (MeloWebplayerGrabberHedge, hedge);
+  g_free (job->url);
+  g_free (job->id_str);
+  g_slice_free (MeloWebplayerGrabberJob, job);
+}
+
+void
+melo_webplayer_grabber_free (MeloWebplayerGrabber *grabber)
+{
+  MeloWebplayerGrabberJob *job;
+  unsigned int i;
+
+  if (!grabber)
+    return;
+
+  /* Stop workers */
+  g_mutex_lock (&grabber->mutex);
+  grabber->stop = true;
+  g_cond_broadcast (&grabber->cond);
+  g_mutex_unlock (&grabber->mutex);
+
+  /* Abort running jobs */
+  melo_webplayer_grabber_interrupt (
+      grabber, 0, MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT);
+
+  /* Stop abort thread once pending aborts are done */
+  if (grabber->abort_thread) {
+    g_mutex_lock (&grabber->abort_mutex);
+    grabber->abort_stop = true;
+    g_cond_signal (&grabber->abort_cond);
+    g_mutex_unlock (&grabber->abort_mutex);
+    g_thread_join (grabber->abort_thread);
+  }
+
+  /* Wait end of workers: the first worker finalizes Python */
+  for (i = grabber->count; i > 0; i--) {
+    g_thread_join (grabber->workers[i - 1].thread);
+    g_mutex_clear (&grabber->workers[i - 1].lock);
+  }
+
+  /* Drop pending jobs */
+  for (i = 0; i < MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT; i++)
+    while ((job = g_queue_pop_head (&grabber->queues[i])) != NULL)
+      melo_webplayer_grabber_job_free (grabber, job, NULL);
+
+  /* Free grabber */
+  g_free (grabber->workers);
+  g_cond_clear (&grabber->abort_cond);
+  g_mutex_clear (&grabber->abort_mutex);
+  g_cond_clear (&grabber->cond);
+  g_mutex_clear (&grabber->mutex);
+  g_mutex_clear (&grabber->cookie_mutex);
+  g_free (grabber->helper);
+  g_free (grabber->cache_path);
+  g_free (grabber->path);
+  g_slice_free (MeloWebplayerGrabber, grabber);
+}
+
+void
+melo_webplayer_grabber_set_lean (MeloWebplayerGrabber *grabber, bool lean)
+{
+  if (grabber)
+    grabber->lean = lean;
+}
+
+void
+melo_webplayer_grabber_load (MeloWebplayerGrabber *grabber)
+{
+  if (!grabber)
+    return;
+
+  /* Wake up all workers to load module */
+  g_mutex_lock (&grabber->mutex);
+  grabber->load++;
+  grabber->start = true;
+  g_cond_broadcast (&grabber->cond);
+  g_mutex_unlock (&grabber->mutex);
+}
+
+void
+melo_webplayer_grabber_compile (MeloWebplayerGrabber *grabber)
+{
+  if (!grabber)
+    return;
+
+  /* Wake up a worker to compile module: workers reload it when done */
+  g_mutex_lock (&grabber->mutex);
+  g_atomic_int_inc (&grabber->version);
+  grabber->compile = true;
+  grabber->start = true;
+  g_cond_broadcast (&grabber->cond);
+  g_mutex_unlock (&grabber->mutex);
+}
+
+static void
+melo_webplayer_grabber_job_update (
+    MeloWebplayerGrabber *grabber, MeloWebplayerGrabberJob *job)
+{
+  MeloWebplayerGrabberPriority priority =
+      MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT;
+  GSList *l;
+
+  /* Job priority is the highest priority of its waiters */
+  for (l = *melo_webplayer_grabber_job_waiters (job); l != NULL; l = l->next) {
+    MeloWebplayerGrabberWaiter *waiter = l->data;
+
+    if (waiter->priority < priority)
+      priority = waiter->priority;
+  }
+
+  /* Move pending job to its new queue */
+  if (priority == MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT ||
+      priority == job->priority)
+    return;
+  if (!job->running) {
+    g_queue_remove (&grabber->queues[job->priority], job);
+    g_queue_push_tail (&grabber->queues[priority], job);
+  }
+  job->priority = priority;
+}
+
+static MeloWebplayerGrabberJob *
+melo_webplayer_grabber_find (MeloWebplayerGrabber *grabber, const char *id)
+{
+  unsigned int i;
+  GList *l;
+
+  if (!id)
+    return NULL;
+
+  /* Find running job of same media, which has not lost its hedge race */
+  for (l = grabber->active.head; l != NULL; l = l->next) {
+    MeloWebplayerGrabberJob *job = l->data;
+
+    if (!job->dropped && !(job->hedge && job->hedge->done) &&
+        !g_strcmp0 (job->id_str, id))
+      return job;
+  }
+
+  /* Find pending job of same media */
+  for (i = 0; i < MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT; i++) {
+    for (l = grabber->queues[i].head; l != NULL; l = l->next) {
+      MeloWebplayerGrabberJob *job = l->data;
+
+      if (!g_strcmp0 (job->id_str, id))
+        return job;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+melo_webplayer_grabber_drop_waiters (MeloWebplayerGrabber *grabber,
+    MeloWebplayerGrabberJob *job, unsigned int id,
+    MeloWebplayerGrabberPriority priority, unsigned int keep, GSList **dropped,
+    GQueue *jobs, GArray *aborted)
+{
+  GSList **waiters = melo_webplayer_grabber_job_waiters (job), **l;
+
+  /* Remove matching waiters: by ID, or all waiters with a priority but the
+   * one to keep
+   */
+  for (l = waiters; *l != NULL;) {
+    MeloWebplayerGrabberWaiter *waiter = (*l)->data;
+
+    if ((id && waiter->id == id) ||
+        (!id && waiter->priority == priority && waiter->id != keep)) {
+      GSList *link = *l;
+
+      *l = link->next;
+      link->next = *dropped;
+      *dropped = link;
+    } else
+      l = &(*l)->next;
+  }
+
+  /* Job is still needed */
+  if (*waiters) {
+    melo_webplayer_grabber_job_update (grabber, job);
+    return;
+  }
+
+  /* Drop pending job or abort running job */
+  if (grabber->hedge_job == job)
+    grabber->hedge_job = NULL;
+  if (!job->running) {
+    g_queue_remove (&grabber->queues[job->priority], job);
+    g_queue_push_tail (jobs, job);
+  } else if (!job->dropped) {
+    job->dropped = true;
+    g_array_append_val (aborted, job->id);
+  }
+}
+
+static void
+melo_webplayer_grabber_drop (MeloWebplayerGrabber *grabber, unsigned int id,
+    MeloWebplayerGrabberPriority priority, unsigned int keep)
+{
+  GArray *aborted = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  GQueue jobs = G_QUEUE_INIT, all = G_QUEUE_INIT;
+  MeloWebplayerGrabberJob *job;
+  GSList *dropped = NULL;
+  unsigned int i;
+  GList *l;
+
+  g_mutex_lock (&grabber->mutex);
+
+  /* List running and pending jobs */
+  for (l = grabber->active.head; l != NULL; l = l->next)
+    g_queue_push_tail (&all, l->data);
+  for (i = 0; i < MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT; i++)
+    for (l = grabber->queues[i].head; l != NULL; l = l->next)
+      g_queue_push_tail (&all, l->data);
+
+  /* Remove waiters */
+  while ((job = g_queue_pop_head (&all)) != NULL)
+    melo_webplayer_grabber_drop_waiters (
+        grabber, job, id, priority, keep, &dropped, &jobs, aborted);
+
+  g_mutex_unlock (&grabber->mutex);
+
+  /* Abort running jobs without waiters */
+  for (i = 0; i < aborted->len; i++)
+    melo_webplayer_grabber_interrupt (grabber,
+        g_array_index (aborted, unsigned int, i),
+        MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT);
+  g_array_free (aborted, TRUE);
+
+  /* Release dropped waiters and pending jobs */
+  melo_webplayer_grabber_notify (dropped, NULL);
+  while ((job = g_queue_pop_head (&jobs)) != NULL)
+    melo_webplayer_grabber_job_free (grabber, job, NULL);
+}
+
+unsigned int
+melo_webplayer_grabber_resolve (MeloWebplayerGrabber *grabber,
+    const char *url, const char *id, MeloWebplayerGrabberPriority priority,
+    MeloWebplayerGrabberCb cb, void *user_data)
+{
+  MeloWebplayerGrabberWaiter *waiter;
+  MeloWebplayerGrabberJob *job;
+  unsigned int waiter_id;
+  bool preempt = false;
+
+  if (!grabber || !url || priority >= MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT) {
+    if (cb)
+      cb (NULL, user_data);
+    return 0;
+  }
+
+  /* Create waiter */
+  waiter = g_slice_new0 (MeloWebplayerGrabberWaiter);
+  waiter->priority = priority;
+  waiter->cb = cb;
+  waiter->user_data = user_data;
+
+  g_mutex_lock (&grabber->mutex);
+
+  /* Set waiter ID */
+  if (!++grabber->job_id)
+    grabber->job_id++;
+  waiter_id = waiter->id = grabber->job_id;
+
+  /* Share job of same media */
+  job = melo_webplayer_grabber_find (grabber, id);
+  if (job) {
+    GSList **waiters = melo_webplayer_grabber_job_waiters (job);
+
+    *waiters = g_slist_append (*waiters, waiter);
+    melo_webplayer_grabber_job_update (grabber, job);
+    MELO_LOGD ("job %u shared for %s", job->id, id);
+  } else {
+    /* Create job */
+    job = g_slice_new0 (MeloWebplayerGrabberJob);
+    job->id = waiter_id;
+    job->priority = priority;
+    job->url = g_strdup (url);
+    job->id_str = g_strdup (id);
+    job->queue_time = g_get_monotonic_time ();
+    job->waiters = g_slist_append (NULL, waiter);
+
+    /* Play job on a slow extractor is hedged with another client */
+    if (priority == MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY &&
+        MELO_WEBPLAYER_GRABBER_HEDGE_DELAY &&
+        !g_strcmp0 (melo_webplayer_route_find (url),
+            MELO_WEBPLAYER_GRABBER_HEDGE_IE))
+      job->hedge_time = MELO_WEBPLAYER_GRABBER_HEDGE_DELAY * 1000;
+
+    /* Queue job: first request starts Python */
+    g_queue_push_tail (&grabber->queues[priority], job);
+    if (!grabber->start) {
+      grabber->start = true;
+      g_cond_broadcast (&grabber->cond);
+    } else
+      g_cond_signal (&grabber->cond);
+  }
+
+  /* No idle worker: play job preempts a background job */
+  preempt = priority == MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY &&
+            !job->running && grabber->idle < grabber->queues[priority].length;
+
+  MELO_LOGD ("queue depth: %u play, %u next, %u prefetch (%u running)",
+      grabber->queues[MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY].length,
+      grabber->queues[MELO_WEBPLAYER_GRABBER_PRIORITY_NEXT].length,
+      grabber->queues[MELO_WEBPLAYER_GRABBER_PRIORITY_PREFETCH].length,
+      grabber->active.length);
+
+  g_mutex_unlock (&grabber->mutex);
+
+  /* Only latest play request is kept */
+  if (priority == MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY)
+    melo_webplayer_grabber_drop (grabber, 0, priority, waiter_id);
+
+  /* Free a worker for play job */
+  if (preempt)
+    melo_webplayer_grabber_preempt (grabber);
+
+  return waiter_id;
+}
+
+void
+melo_webplayer_grabber_cancel (MeloWebplayerGrabber *grabber, unsigned int id)
+{
+  if (!grabber || !id)
+    return;
+
+  /* Remove waiter: its job is dropped or aborted if not shared */
+  melo_webplayer_grabber_drop (
+      grabber, id, MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT, 0);
+}
+
+unsigned int
+melo_webplayer_grabber_get_pending (
+    MeloWebplayerGrabber *grabber, MeloWebplayerGrabberPriority priority)
+{
+  unsigned int count = 0, i;
+
+  if (!grabber)
+    return 0;
+
+  g_mutex_lock (&grabber->mutex);
+  for (i = 0; i < MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT; i++)
+    if (i == priority || priority == MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT)
+      count += grabber->queues[i].length;
+  g_mutex_unlock (&grabber->mutex);
+
+  return count;
+}
+
+static MeloWebplayerGrabberJob *
+melo_webplayer_grabber_hedge (MeloWebplayerGrabberJob *job)
+{
+  MeloWebplayerGrabberHedge *hedge;
+  MeloWebplayerGrabberJob *copy;
+
+  /* Share waiters between both attempts */
+  hedge = g_slice_new0 (MeloWebplayerGrabberHedge);
+  hedge->count = 2;
+  hedge->waiters = job->waiters;
+  job->waiters = NULL;
+  job->hedge = hedge;
+
+  /* Create attempt with another client: it has the same ID */
+  copy = g_slice_new0 (MeloWebplayerGrabberJob);
+  copy->id = job->id;
+  copy->priority = job->priority;
+  copy->url = g_strdup (job->url);
+  copy->id_str = g_strdup (job->id_str);
+  copy->client = MELO_WEBPLAYER_GRABBER_HEDGE_CLIENT;
+  copy->hedge = hedge;
+
+  MELO_LOGI ("extraction of %s is slow: hedge with %s client", job->id_str,
+      copy->client);
+
+  return copy;
+}
+
+static bool
+melo_webplayer_grabber_requeue (
+    MeloWebplayerGrabber *grabber, MeloWebplayerGrabberJob *job)
+{
+  bool ret = false;
+
+  g_mutex_lock (&grabber->mutex);
+
+  /* Preempted job is queued again, unless it has been dropped meanwhile */
+  if (!job->hedge && !job->dropped && job->waiters) {
+    g_queue_remove (&grabber->active, job);
+    job->running = false;
+    job->cancelled = false;
+    job->preempted = false;
+    g_queue_push_head (&grabber->queues[job->priority], job);
+    g_cond_signal (&grabber->cond);
+    ret = true;
+  }
+
+  g_mutex_unlock (&grabber->mutex);
+
+  if (ret)
+    MELO_LOGD ("job %u preempted: queued again", job->id);
+
+  return ret;
+}
+
+static MeloWebplayerGrabberJob *
+melo_webplayer_grabber_pop (
+    MeloWebplayerGrabberWorker *worker, MeloWebplayerGrabberTask *task)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  MeloWebplayerGrabberJob *job = NULL;
+  unsigned int i;
+
+  g_mutex_lock (&grabber->mutex);
+
+  /* Wait next job, by priority order */
+  while (!grabber->stop) {
+    gint64 now = g_get_monotonic_time ();
+
+    for (i = 0; i < MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT && !job; i++)
+      job = g_queue_pop_head (&grabber->queues[i]);
+    if (job) {
+      /* Report time spent in queue */
+      if (job->queue_time) {
+        melo_webplayer_stats_add (
+            MELO_WEBPLAYER_STATS_PHASE_QUEUE_WAIT, job->queue_time);
+        job->queue_time = 0;
+      }
+
+      /* Job can be hedged after a delay */
+      if (job->hedge_time) {
+        job->hedge_time += now;
+        grabber->hedge_job = job;
+      }
+      break;
+    }
+
+    /* Slow play job: hedge it on this idle worker */
+    if (grabber->hedge_job && now >= grabber->hedge_job->hedge_time) {
+      job = melo_webplayer_grabber_hedge (grabber->hedge_job);
+      grabber->hedge_job = NULL;
+      break;
+    }
+
+    /* Module compilation requested */
+    if (grabber->compile) {
+      grabber->compile = false;
+      grabber->compiling = true;
+      *task = MELO_WEBPLAYER_GRABBER_TASK_COMPILE;
+      break;
+    }
+
+    /* Module load requested: import compiled module */
+    if (worker->load != grabber->load && !grabber->compiling) {
+      worker->load = grabber->load;
+      grabber->loading++;
+      *task = MELO_WEBPLAYER_GRABBER_TASK_LOAD;
+      break;
+    }
+
+    /* Wait until running play job can be hedged */
+    grabber->idle++;
+    if (grabber->hedge_job)
+      g_cond_wait_until (
+          &grabber->cond, &grabber->mutex, grabber->hedge_job->hedge_time);
+    else
+      g_cond_wait (&grabber->cond, &grabber->mutex);
+    grabber->idle--;
+  }
+
+  /* Job is running */
+  if (job) {
+    job->running = true;
+    g_queue_push_tail (&grabber->active, job);
+  }
+
+  g_mutex_unlock (&grabber->mutex);
+
+  return job;
+}
+
+static bool
+melo_webplayer_grabber_is_loaded (MeloWebplayerGrabber *grabber)
+{
+  unsigned int i;
+
+  /* Compilation is pending or running */
+  if (grabber->compile || grabber->compiling || grabber->loading)
+    return false;
+
+  /* A worker has not yet started last load request */
+  for (i = 0; i < grabber->count; i++)
+    if (grabber->workers[i].load != grabber->load)
+      return false;
+
+  return true;
+}
+
+void
+melo_webplayer_grabber_wait (MeloWebplayerGrabber *grabber)
+{
+  if (!grabber)
+    return;
+
+  /* Wait end of load and compile requests */
+  g_mutex_lock (&grabber->mutex);
+  while (!grabber->stop && !melo_webplayer_grabber_is_loaded (grabber))
+    g_cond_wait (&grabber->cond, &grabber->mutex);
+  g_mutex_unlock (&grabber->mutex);
+}
+
+static void
+melo_webplayer_grabber_set_frozen (void)
+{
+  PyObject *frozen;
+
+  /* HACK: prevent internal updater by setting sys.frozen */
+  frozen = PyUnicode_FromString ("melo");
+  PySys_SetObject ("frozen", frozen);
+  Py_DECREF (frozen);
+}
+
+static void
+melo_webplayer_grabber_init_python (MeloWebplayerGrabber *grabber)
+{
+  bool start;
+
+  /* Wait first request to not slow down daemon startup */
+  g_mutex_lock (&grabber->mutex);
+  while (!grabber->start && !grabber->stop)
+    g_cond_wait (&grabber->cond, &grabber->mutex);
+  start = grabber->start;
+  g_mutex_unlock (&grabber->mutex);
+
+  /* Python not yet initialized: not needed with helper processes */
+  if (start && !grabber->helper && !Py_IsInitialized ()) {
+    gint64 t0 = g_get_monotonic_time ();
+    PyStatus status;
+    PyConfig config;
+    wchar_t *path;
+    size_t len;
+
+    /* Generate Python configuration */
+    PyConfig_InitPythonConfig (&config);
+    PyConfig_Read (&config);
+
+    /* Generate python path */
+    len = strlen (grabber->path) + sizeof (MELO_WEBPLAYER_GRABBER_PATH) + 3;
+    path = malloc (len * sizeof (*path));
+    swprintf (path, len, L"%s/%s", grabber->path, MELO_WEBPLAYER_GRABBER_PATH);
+
+    /* Set module search path */
+    config.module_search_paths_set = 1;
+    PyWideStringList_Append (&config.module_search_paths, path);
+    free (path);
+
+    /* Store bytecode in a dedicated directory */
+    if (grabber->cache_path) {
+      char *pycache = g_build_filename (
+          grabber->cache_path, MELO_WEBPLAYER_GRABBER_PYCACHE, NULL);
+      PyConfig_SetBytesString (&config, &config.pycache_prefix, pycache);
+      g_free (pycache);
+    }
+
+    /* Initialize python */
+    status = Py_InitializeFromConfig (&config);
+    PyConfig_Clear (&config);
+    if (PyStatus_Exception (status)) {
+      MELO_LOGE ("failed to initialize python: %s", status.err_msg);
+    } else {
+      melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_PY_INIT, t0);
+      melo_webplayer_grabber_set_frozen ();
+
+      /* Release GIL for workers */
+      grabber->main_tstate = PyEval_SaveThread ();
+      grabber->finalize = true;
+    }
+  }
+
+  /* Wake up other workers */
+  g_mutex_lock (&grabber->mutex);
+  grabber->initialized = true;
+  g_cond_broadcast (&grabber->cond);
+  g_mutex_unlock (&grabber->mutex);
+}
+
+static void
+melo_webplayer_grabber_worker_abort (MeloWebplayerGrabberWorker *worker)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+
+  /* Must be called with worker lock held */
+  worker->job->cancelled = true;
+
+  /* Kill helper process */
+  if (worker->helper) {
+    melo_webplayer_helper_abort (worker->helper);
+    MELO_LOGD ("job %u aborted on worker %u", worker->job->id, worker->index);
+    return;
+  }
+
+  /* Let abort thread raise the exception: acquiring the GIL can take as
+   * long as the running extraction
+   */
+  worker->abort = worker->run;
+  g_mutex_lock (&grabber->abort_mutex);
+  grabber->abort_pending = true;
+  g_cond_signal (&grabber->abort_cond);
+  g_mutex_unlock (&grabber->abort_mutex);
+}
+
+static void
+melo_webplayer_grabber_worker_raise (MeloWebplayerGrabberWorker *worker)
+{
+  PyThreadState *tstate = NULL;
+  PyGILState_STATE gstate;
+  unsigned int run;
+
+  /* Get abort request of running job */
+  g_mutex_lock (&worker->lock);
+  run = worker->job && worker->abort == worker->run ? worker->abort : 0;
+  worker->abort = 0;
+  g_mutex_unlock (&worker->lock);
+  if (!run)
+    return;
+
+  /* Acquire GIL of worker interpreter */
+  if (worker->tstate) {
+    tstate =
+        PyThreadState_New (PyThreadState_GetInterpreter (worker->tstate));
+    PyEval_RestoreThread (tstate);
+  } else
+    gstate = PyGILState_Ensure ();
+
+  /* Raise an exception in worker thread, unless job is done */
+  g_mutex_lock (&worker->lock);
+  if (worker->job && worker->run == run) {
+    PyThreadState_SetAsyncExc (worker->ident, PyExc_KeyboardInterrupt);
+    MELO_LOGD ("job %u aborted on worker %u", worker->job->id, worker->index);
+  }
+  g_mutex_unlock (&worker->lock);
+
+  /* Release GIL */
+  if (tstate) {
+    PyThreadState_Clear (tstate);
+    PyThreadState_DeleteCurrent ();
+  } else
+    PyGILState_Release (gstate);
+}
+
+static gpointer
+melo_webplayer_grabber_abort_thread_func (gpointer user_data)
+{
+  MeloWebplayerGrabber *grabber = user_data;
+  unsigned int i;
+
+  g_mutex_lock (&grabber->abort_mutex);
+  while (true) {
+    /* Wait abort requests: pending ones are done before stopping */
+    while (!grabber->abort_pending && !grabber->abort_stop)
+      g_cond_wait (&grabber->abort_cond, &grabber->abort_mutex);
+    if (!grabber->abort_pending)
+      break;
+    grabber->abort_pending = false;
+    g_mutex_unlock (&grabber->abort_mutex);
+
+    /* Raise exceptions in workers */
+    for (i = 0; i < grabber->count; i++)
+      melo_webplayer_grabber_worker_raise (&grabber->workers[i]);
+
+    g_mutex_lock (&grabber->abort_mutex);
+  }
+  g_mutex_unlock (&grabber->abort_mutex);
+
+  return NULL;
+}
+
+static void
+melo_webplayer_grabber_interrupt (MeloWebplayerGrabber *grabber,
+    unsigned int id, MeloWebplayerGrabberPriority priority)
+{
+  unsigned int i;
+
+  if (!grabber->helper && !Py_IsInitialized ())
+    return;
+
+  for (i = 0; i < grabber->count; i++) {
+    MeloWebplayerGrabberWorker *worker = &grabber->workers[i];
+    MeloWebplayerGrabberJob *job;
+
+    /* The job cannot end while the worker lock is held */
+    g_mutex_lock (&worker->lock);
+
+    /* Check running job */
+    job = worker->job;
+    if (job && !job->cancelled &&
+        ((id && job->id == id) || (!id && job->priority <= priority)))
+      melo_webplayer_grabber_worker_abort (worker);
+
+    g_mutex_unlock (&worker->lock);
+  }
+}
+
+static void
+melo_webplayer_grabber_preempt (MeloWebplayerGrabber *grabber)
+{
+  MeloWebplayerGrabberPriority priority =
+      MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY;
+  MeloWebplayerGrabberWorker *target = NULL;
+  unsigned int i;
+
+  if (!grabber->helper && !Py_IsInitialized ())
+    return;
+
+  /* Find running job with lowest priority */
+  for (i = 0; i < grabber->count; i++) {
+    MeloWebplayerGrabberWorker *worker = &grabber->workers[i];
+
+    g_mutex_lock (&worker->lock);
+    if (worker->job && !worker->job->cancelled && !worker->job->hedge &&
+        worker->job->priority > priority) {
+      priority = worker->job->priority;
+      target = worker;
+    }
+    g_mutex_unlock (&worker->lock);
+  }
+  if (!target)
+    return;
+
+  /* Abort it: it is queued again when worker is released */
+  g_mutex_lock (&target->lock);
+  if (target->job && !target->job->cancelled &&
+      target->job->priority == priority) {
+    target->job->preempted = true;
+    melo_webplayer_grabber_worker_abort (target);
+  }
+  g_mutex_unlock (&target->lock);
+}
+
+static void
+melo_webplayer_grabber_worker_attach (MeloWebplayerGrabberWorker *worker)
+{
+  if (worker->tstate)
+    PyEval_RestoreThread (worker->tstate);
+  else
+    worker->gstate = PyGILState_Ensure ();
+}
+
+static void
+melo_webplayer_grabber_worker_detach (MeloWebplayerGrabberWorker *worker)
+{
+  if (worker->tstate)
+    worker->tstate = PyEval_SaveThread ();
+  else
+    PyGILState_Release (worker->gstate);
+}
+
+#ifdef MELO_WEBPLAYER_GRABBER_SUBINTERPRETER
+static void
+melo_webplayer_grabber_worker_end_interpreter (
+    MeloWebplayerGrabberWorker *worker)
+{
+  /* End interpreter (must be attached) */
+  Py_EndInterpreter (worker->tstate);
+  worker->tstate = NULL;
+
+  /* Release main interpreter thread state */
+  PyEval_RestoreThread (worker->main_tstate);
+  PyThreadState_Clear (worker->main_tstate);
+  PyThreadState_DeleteCurrent ();
+  worker->main_tstate = NULL;
+}
+#endif
+
+static void
+melo_webplayer_grabber_worker_init (MeloWebplayerGrabberWorker *worker)
+{
+#ifdef MELO_WEBPLAYER_GRABBER_SUBINTERPRETER
+  PyInterpreterConfig config = {
+      .use_main_obmalloc = 0,
+      .allow_fork = 0,
+      .allow_exec = 0,
+      .allow_threads = 1,
+      .allow_daemon_threads = 0,
+      .check_multi_interp_extensions = 1,
+      .gil = PyInterpreterConfig_OWN_GIL,
+  };
+  PyStatus status;
+
+  /* Create a thread state in main interpreter */
+  worker->main_tstate = PyThreadState_New (PyInterpreterState_Main ());
+  PyEval_RestoreThread (worker->main_tstate);
+
+  /* Create worker interpreter: the main GIL is released on success */
+  status = Py_NewInterpreterFromConfig (&worker->tstate, &config);
+  if (PyStatus_Exception (status)) {
+    MELO_LOGW ("failed to create interpreter %u: %s", worker->index,
+        status.err_msg ? status.err_msg : "unknown error");
+    worker->tstate = NULL;
+
+    /* Use main interpreter */
+    PyThreadState_Clear (worker->main_tstate);
+    PyThreadState_DeleteCurrent ();
+    worker->main_tstate = NULL;
+    return;
+  }
+
+  /* Setup interpreter */
+  melo_webplayer_grabber_set_frozen ();
+  worker->tstate = PyEval_SaveThread ();
+#endif
+}
+
+static void
+melo_webplayer_grabber_worker_cleanup (MeloWebplayerGrabberWorker *worker)
+{
+  /* Release python objects */
+  melo_webplayer_grabber_worker_attach (worker);
+  Py_CLEAR (worker->instance);
+  Py_CLEAR (worker->module);
+
+#ifdef MELO_WEBPLAYER_GRABBER_SUBINTERPRETER
+  if (worker->tstate) {
+    melo_webplayer_grabber_worker_end_interpreter (worker);
+    return;
+  }
+#endif
+
+  melo_webplayer_grabber_worker_detach (worker);
+}
+
+static PyObject *
+melo_webplayer_grabber_create_params (MeloWebplayerGrabber *grabber)
+{
+  PyObject *params;
+
+  /* Base parameters
+   *  - quiet=True (prevent that method call fails when running as daemon)
+   *  - socket_timeout (bound the time a job cannot be aborted)
+   */
+  params = Py_BuildValue ("{s:O,s:i}", "quiet", Py_True, "socket_timeout",
+      MELO_WEBPLAYER_GRABBER_SOCKET_TIMEOUT);
+
+  /* Persistent state: player JS deciphering and cookies (with visitor data)
+   * are kept across restarts.
+   */
+  if (params && grabber->cache_path) {
+    PyObject *extra;
+    char *cache, *cookies;
+
+    cache = g_build_filename (
+        grabber->cache_path, MELO_WEBPLAYER_GRABBER_CACHE, NULL);
+    cookies = g_build_filename (
+        grabber->cache_path, MELO_WEBPLAYER_GRABBER_COOKIES, NULL);
+    extra = Py_BuildValue ("{s:s,s:s}", "cachedir", cache, "cookiefile",
+        cookies);
+    if (!extra || PyDict_Update (params, extra)) {
+      Py_CLEAR (params);
+      PyErr_Print ();
+    }
+    Py_XDECREF (extra);
+    g_free (cookies);
+    g_free (cache);
+  }
+
+  /* Lean parameters: only extract what is needed to get audio URLs
+   *  - no warnings, no download, no playlist expansion,
+   *  - no thumbnails, subtitles and comments,
+   *  - formats are not checked and the grabber format selection is cheap,
+   *  - HLS / DASH manifests and translated subtitles are not fetched.
+   */
+  if (params && grabber->lean) {
+    PyObject *extra;
+
+    extra = Py_BuildValue (
+        "{s:O,s:O,s:O,s:O,s:O,s:O,s:O,s:O,s:s,s:{s:{s:[s,s,s]}}}",
+        "no_warnings", Py_True, "skip_download", Py_True, "noplaylist",
+        Py_True, "writethumbnail", Py_False, "writesubtitles", Py_False,
+        "writeautomaticsub", Py_False, "getcomments", Py_False,
+        "check_formats", Py_False, "format", "bestaudio/best",
+        "extractor_args", "youtube", "skip", "hls", "dash",
+        "translated_subs");
+    if (!extra || PyDict_Update (params, extra)) {
+      Py_CLEAR (params);
+      PyErr_Print ();
+    }
+    Py_XDECREF (extra);
+  }
+
+  /* Arguments tuple */
+  return params ? Py_BuildValue ("(N)", params) : NULL;
+}
+
+static bool
+melo_webplayer_grabber_worker_outdated (MeloWebplayerGrabberWorker *worker)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  bool ret;
+
+  /* A new version is used once its bytecode is ready */
+  g_mutex_lock (&grabber->mutex);
+  ret = worker->version != grabber->version && !grabber->compile &&
+        !grabber->compiling;
+  g_mutex_unlock (&grabber->mutex);
+
+  return ret;
+}
+
+static void
+melo_webplayer_grabber_worker_reload (MeloWebplayerGrabberWorker *worker)
+{
+  /* Module not imported yet */
+  if (!worker->module)
+    return;
+
+  /* Release previous version: new one is imported on next load, running
+   * extractions of other workers keep their own references.
+   */
+  Py_CLEAR (worker->instance);
+  Py_CLEAR (worker->module);
+  PyGC_Collect ();
+
+  MELO_LOGI ("worker %u switches to new module version", worker->index);
+}
+
+static void
+melo_webplayer_grabber_worker_purge (MeloWebplayerGrabberWorker *worker)
+{
+  PyObject *modules, *module, *tag, *keys, *importlib, *ret = NULL;
+  size_t len = strlen (MELO_WEBPLAYER_GRABBER_MODULE);
+  Py_ssize_t i, count;
+  long version = -1;
+
+  /* Module not imported in this interpreter */
+  modules = PyImport_GetModuleDict ();
+  module = PyDict_GetItemString (modules, MELO_WEBPLAYER_GRABBER_MODULE);
+  if (!module)
+    return;
+
+  /* Module already imported from current version by another worker */
+  tag = PyObject_GetAttrString (module, MELO_WEBPLAYER_GRABBER_VERSION_ATTR);
+  if (tag)
+    version = PyLong_AsLong (tag);
+  Py_XDECREF (tag);
+  PyErr_Clear ();
+  if (version == worker->version)
+    return;
+
+  /* Remove module and its sub-modules from import cache */
+  keys = PyDict_Keys (modules);
+  count = keys ? PyList_Size (keys) : 0;
+  for (i = 0; i < count; i++) {
+    PyObject *key = PyList_GetItem (keys, i);
+    const char *name = PyUnicode_Check (key) ? PyUnicode_AsUTF8 (key) : NULL;
+
+    if (name && !strncmp (name, MELO_WEBPLAYER_GRABBER_MODULE, len) &&
+        (name[len] == '\0' || name[len] == '.'))
+      PyDict_DelItem (modules, key);
+  }
+  Py_XDECREF (keys);
+
+  /* Module directory has been replaced */
+  importlib = PyImport_ImportModule ("importlib");
+  if (importlib)
+    ret = PyObject_CallMethod (importlib, "invalidate_caches", NULL);
+  if (!ret)
+    MELO_LOGW ("failed to invalidate import caches");
+  Py_XDECREF (ret);
+  Py_XDECREF (importlib);
+  PyErr_Clear ();
+}
+
+static void
+melo_webplayer_grabber_worker_tag (MeloWebplayerGrabberWorker *worker)
+{
+  PyObject *version;
+
+  version = PyLong_FromLong (worker->version);
+  if (!version ||
+      PyObject_SetAttrString (
+          worker->module, MELO_WEBPLAYER_GRABBER_VERSION_ATTR, version))
+    PyErr_Clear ();
+  Py_XDECREF (version);
+}
+
+static bool
+melo_webplayer_grabber_worker_load (MeloWebplayerGrabberWorker *worker)
+{
+  PyObject *dict, *class, *args;
+  gint64 start;
+
+  /* Already loaded */
+  if (worker->instance)
+    return true;
+
+  /* Import module */
+  if (!worker->module) {
+    PyObject *name;
+
+    /* Drop modules of a previous version */
+    worker->version = g_atomic_int_get (&worker->grabber->version);
+    melo_webplayer_grabber_worker_purge (worker);
+
+    /* Create module name */
+    name = PyUnicode_FromString (MELO_WEBPLAYER_GRABBER_MODULE);
+
+    /* Import module */
+    start = g_get_monotonic_time ();
+    worker->module = PyImport_Import (name);
+    Py_DECREF (name);
+    if (!worker->module) {
+      MELO_LOGE ("failed to import module");
+
+      /* Print Python backtrace */
+      PyErr_Print ();
+
+#ifdef MELO_WEBPLAYER_GRABBER_SUBINTERPRETER
+      /* Module may not support isolated interpreters: use main interpreter */
+      if (worker->tstate) {
+        melo_webplayer_grabber_worker_end_interpreter (worker);
+        melo_webplayer_grabber_worker_attach (worker);
+        return melo_webplayer_grabber_worker_load (worker);
+      }
+#endif
+      return false;
+    }
+
+    melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_IMPORT, start);
+    MELO_LOGD ("module imported by worker %u", worker->index);
+
+    /* Tag module with its version */
+    melo_webplayer_grabber_worker_tag (worker);
+  }
+
+  /* Get module dictionary */
+  dict = PyModule_GetDict (worker->module);
+  if (!dict) {
+    MELO_LOGE ("failed to get module dictionary");
+    return false;
+  }
+
+  /* Get class from module */
+  class = PyDict_GetItemString (dict, MELO_WEBPLAYER_GRABBER_CLASS);
+  if (!class) {
+    MELO_LOGE ("failed to get class");
+    return false;
+  }
+
+  /* Prepare instance arguments */
+  args = melo_webplayer_grabber_create_params (worker->grabber);
+  if (!args) {
+    MELO_LOGE ("failed to create instance args");
+    return false;
+  }
+
+  /* Create object instance */
+  start = g_get_monotonic_time ();
+  worker->instance = PyObject_CallObject (class, args);
+  Py_DECREF (args);
+  if (!worker->instance) {
+    MELO_LOGE ("failed to instantiate object");
+    PyErr_Print ();
+    return false;
+  }
+  melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_INSTANTIATE, start);
+  MELO_LOGD ("object instantiated by worker %u", worker->index);
+
+  return true;
+}
+
+static const char *
+melo_webplayer_grabber_get_string (PyObject *fmt, const char *key)
+{
+  PyObject *tmp;
+
+  /* Get string value */
+  tmp = PyDict_GetItemString (fmt, key);
+  if (!tmp || !PyUnicode_Check (tmp))
+    return NULL;
+
+  return PyUnicode_AsUTF8 (tmp);
+}
+
+static MeloWebplayerStream *
+melo_webplayer_grabber_select_stream (PyObject *result, const char *id)
+{
+  MeloWebplayerStream *stream = NULL;
+  MeloWebplayerFormat *fmts;
+  unsigned int i, count;
+  PyObject *formats;
+  int best;
+
+  /* Get formats */
+  formats = PyDict_GetItemString (result, "formats");
+  if (!formats || !PyList_Check (formats)) {
+    MELO_LOGE ("failed to list formats");
+    return NULL;
+  }
+
+  /* Get formats count */
+  count = PyList_Size (formats);
+  fmts = g_new0 (MeloWebplayerFormat, count);
+
+  /* Convert formats list: strings are valid as long as result is */
+  for (i = 0; i < count; i++) {
+    MeloWebplayerFormat *f = &fmts[i];
+    PyObject *fmt, *tmp;
+
+    /* Get next format */
+    fmt = PyList_GetItem (formats, i);
+    if (!fmt || !PyDict_Check (fmt))
+      continue;
+
+    /* Get URL and codecs */
+    f->url = melo_webplayer_grabber_get_string (fmt, "url");
+    f->acodec = melo_webplayer_grabber_get_string (fmt, "acodec");
+    f->vcodec = melo_webplayer_grabber_get_string (fmt, "vcodec");
+
+    /* Get audio bitrate */
+    tmp = PyDict_GetItemString (fmt, "abr");
+    if (!tmp || tmp == Py_None)
+      tmp = PyDict_GetItemString (fmt, "tbr");
+    if (tmp && (PyFloat_Check (tmp) || PyLong_Check (tmp)))
+      f->bitrate = PyFloat_AsDouble (tmp);
+  }
+
+  /* Select best format */
+  best = melo_webplayer_format_select (NULL, fmts, count);
+  if (best >= 0)
+    stream = melo_webplayer_stream_new (
+        id, fmts[best].url, fmts[best].acodec, fmts[best].bitrate);
+  g_free (fmts);
+
+  return stream;
+}
+
+static void
+melo_webplayer_grabber_worker_compile (MeloWebplayerGrabberWorker *worker)
+{
+  PyObject *module, *func = NULL, *args = NULL, *kwargs = NULL, *ret = NULL;
+  gint64 start = g_get_monotonic_time ();
+  char *path;
+
+  /* Module path */
+  path = g_build_filename (
+      worker->grabber->path, MELO_WEBPLAYER_GRABBER_PATH, NULL);
+
+  /* Compile all module files: bytecode goes to pycache_prefix */
+  module = PyImport_ImportModule ("compileall");
+  if (module)
+    func = PyObject_GetAttrString (module, "compile_dir");
+  if (func) {
+    args = Py_BuildValue ("(s)", path);
+    kwargs = Py_BuildValue ("{s:i}", "quiet", 1);
+  }
+  if (args && kwargs)
+    ret = PyObject_Call (func, args, kwargs);
+
+  if (ret && PyObject_IsTrue (ret))
+    MELO_LOGI ("module compiled in %" G_GINT64_FORMAT " ms",
+        (g_get_monotonic_time () - start) / 1000);
+  else {
+    MELO_LOGW ("failed to compile module");
+    PyErr_Clear ();
+  }
+
+  Py_XDECREF (ret);
+  Py_XDECREF (kwargs);
+  Py_XDECREF (args);
+  Py_XDECREF (func);
+  Py_XDECREF (module);
+  g_free (path);
+}
+
+static PyObject *
+melo_webplayer_grabber_worker_call (
+    MeloWebplayerGrabberWorker *worker, const char *url, bool process)
+{
+  PyObject *func, *args = NULL, *kwargs = NULL, *ret = NULL;
+  const char *ie_key;
+
+  /* Route URL to its extractor, otherwise all extractors are probed */
+  ie_key = melo_webplayer_route_find (url);
+  MELO_LOGD ("%s routed to %s", url, ie_key ? ie_key : "generic probing");
+
+  /* Call extract_info(url, download=False, process, ie_key) */
+  func = PyObject_GetAttrString (worker->instance, "extract_info");
+  if (func) {
+    args = Py_BuildValue ("(s)", url);
+    kwargs = Py_BuildValue ("{s:O,s:O}", "download", Py_False, "process",
+        process ? Py_True : Py_False);
+  }
+  if (kwargs && ie_key) {
+    PyObject *key = PyUnicode_FromString (ie_key);
+
+    if (!key || PyDict_SetItemString (kwargs, "ie_key", key))
+      Py_CLEAR (kwargs);
+    Py_XDECREF (key);
+  }
+  if (args && kwargs)
+    ret = PyObject_Call (func, args, kwargs);
+
+  Py_XDECREF (kwargs);
+  Py_XDECREF (args);
+  Py_XDECREF (func);
+
+  return ret;
+}
+
+static void
+melo_webplayer_grabber_worker_set_client (
+    MeloWebplayerGrabberWorker *worker, const char *client)
+{
+  PyObject *params, *args = NULL, *ie_args = NULL;
+  int ret = -1;
+
+  /* Get YouTube extractor arguments: params["extractor_args"]["youtube"] */
+  params = PyObject_GetAttrString (worker->instance, "params");
+  if (params)
+    args = PyObject_CallMethod (
+        params, "setdefault", "(sN)", "extractor_args", PyDict_New ());
+  if (args)
+    ie_args = PyObject_CallMethod (
+        args, "setdefault", "(sN)", "youtube", PyDict_New ());
+
+  /* Set player client, or restore default clients */
+  if (ie_args && client) {
+    PyObject *clients = Py_BuildValue ("[s]", client);
+
+    if (clients)
+      ret = PyDict_SetItemString (ie_args, "player_client", clients);
+    Py_XDECREF (clients);
+  } else if (ie_args) {
+    ret = 0;
+    if (PyDict_GetItemString (ie_args, "player_client"))
+      ret = PyDict_DelItemString (ie_args, "player_client");
+  }
+  if (ret) {
+    MELO_LOGW ("failed to set player client");
+    PyErr_Clear ();
+  }
+
+  Py_XDECREF (ie_args);
+  Py_XDECREF (args);
+  Py_XDECREF (params);
+}
+
+static void
+melo_webplayer_grabber_worker_save (MeloWebplayerGrabberWorker *worker)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  PyObject *jar, *ret = NULL;
+
+  /* Cookie file is shared by all workers: release the GIL while waiting */
+  Py_BEGIN_ALLOW_THREADS
+  g_mutex_lock (&grabber->cookie_mutex);
+  Py_END_ALLOW_THREADS
+
+  /* Save cookies */
+  jar = PyObject_GetAttrString (worker->instance, "cookiejar");
+  if (jar)
+    ret = PyObject_CallMethod (jar, "save", NULL);
+  if (!ret) {
+    MELO_LOGW ("failed to save cookies");
+    PyErr_Clear ();
+  }
+  Py_XDECREF (ret);
+  Py_XDECREF (jar);
+
+  g_mutex_unlock (&grabber->cookie_mutex);
+}
+
+static bool
+melo_webplayer_grabber_has_player_cache (MeloWebplayerGrabber *grabber)
+{
+  GStatBuf st;
+  const char *name;
+  char *path;
+  time_t mtime;
+  GDir *dir;
+  bool ret = false;
+
+  if (!grabber->cache_path)
+    return false;
+
+  /* Get date of current module version */
+  path = g_build_filename (grabber->path, MELO_WEBPLAYER_GRABBER_PATH,
+      MELO_WEBPLAYER_GRABBER_MODULE, MELO_WEBPLAYER_GRABBER_VERSION_FILE,
+      NULL);
+  if (g_stat (path, &st)) {
+    g_free (path);
+    return false;
+  }
+  mtime = st.st_mtime;
+  g_free (path);
+
+  /* Find an entry saved by current module version */
+  path = g_build_filename (grabber->cache_path, MELO_WEBPLAYER_GRABBER_CACHE,
+      MELO_WEBPLAYER_GRABBER_PLAYER_CACHE, NULL);
+  dir = g_dir_open (path, 0, NULL);
+  while (dir && !ret && (name = g_dir_read_name (dir))) {
+    char *file = g_build_filename (path, name, NULL);
+
+    ret = !g_stat (file, &st) && st.st_mtime >= mtime;
+    g_free (file);
+  }
+  if (dir)
+    g_dir_close (dir);
+  g_free (path);
+
+  return ret;
+}
+
+static void
+melo_webplayer_grabber_worker_prefetch (MeloWebplayerGrabberWorker *worker)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  gint64 start = g_get_monotonic_time ();
+  bool prefetch;
+  PyObject *ret;
+
+  /* Pre-fetch player once per module version, on first loaded worker */
+  g_mutex_lock (&grabber->mutex);
+  prefetch = grabber->prefetched != worker->version;
+  grabber->prefetched = worker->version;
+  g_mutex_unlock (&grabber->mutex);
+  if (!prefetch)
+    return;
+
+  /* Deciphering functions already cached by this version */
+  if (melo_webplayer_grabber_has_player_cache (grabber)) {
+    MELO_LOGD ("player already cached, skip pre-fetch");
+    return;
+  }
+
+  /* Extract a known video without processing formats: the player JS is
+   * fetched and its deciphering functions are cached.
+   */
+  ret = melo_webplayer_grabber_worker_call (
+      worker, MELO_WEBPLAYER_GRABBER_CHECK_URL, false);
+  if (!ret) {
+    MELO_LOGW ("failed to pre-fetch player on worker %u", worker->index);
+    PyErr_Clear ();
+
+    /* Retry on next load */
+    g_mutex_lock (&grabber->mutex);
+    if (grabber->prefetched == worker->version)
+      grabber->prefetched = -1;
+    g_mutex_unlock (&grabber->mutex);
+    return;
+  }
+  Py_DECREF (ret);
+  PyGC_Collect ();
+
+  MELO_LOGD ("player pre-fetched by worker %u in %" G_GINT64_FORMAT " ms",
+      worker->index, (g_get_monotonic_time () - start) / 1000);
+
+  /* Save visitor data for next start */
+  melo_webplayer_grabber_worker_save (worker);
+}
+
+static void
+melo_webplayer_grabber_worker_check (MeloWebplayerGrabberWorker *worker)
+{
+  PyObject *ie, *ret = NULL;
+
+  /* Load extractor and check it handles a known URL */
+  ie = PyObject_CallMethod (worker->instance, "get_info_extractor", "s",
+      MELO_WEBPLAYER_GRABBER_CHECK_IE);
+  if (ie)
+    ret = PyObject_CallMethod (
+        ie, "suitable", "s", MELO_WEBPLAYER_GRABBER_CHECK_URL);
+
+  if (ret && PyObject_IsTrue (ret)) {
+    MELO_LOGI ("worker %u ready", worker->index);
+    melo_webplayer_grabber_worker_prefetch (worker);
+  } else {
+    MELO_LOGW ("self-check failed on worker %u", worker->index);
+    PyErr_Clear ();
+  }
+  Py_XDECREF (ret);
+  Py_XDECREF (ie);
+}
+
+static MeloWebplayerStream *
+melo_webplayer_grabber_worker_extract (
+    MeloWebplayerGrabberWorker *worker, MeloWebplayerGrabberJob *job)
+{
+  MeloWebplayerStream *stream = NULL;
+  PyObject *result;
+  gint64 start, select;
+  unsigned int rss;
+
+  /* Get video info */
+  rss = melo_webplayer_stats_get_rss ();
+  start = g_get_monotonic_time ();
+  result = melo_webplayer_grabber_worker_call (worker, job->url, true);
+  if (!result) {
+    if (PyErr_ExceptionMatches (PyExc_KeyboardInterrupt))
+      MELO_LOGI ("extraction of %s aborted", job->id_str);
+    else
+      MELO_LOGE ("failed to extract video info");
+    PyErr_Clear ();
+    return NULL;
+  }
+
+  melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_EXTRACT, start);
+
+  /* Select best audio stream */
+  select = g_get_monotonic_time ();
+  stream = melo_webplayer_grabber_select_stream (result, job->id_str);
+  melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_SELECT, select);
+
+  /* Release result and its reference cycles */
+  Py_DECREF (result);
+  PyGC_Collect ();
+
+  /* Keep cookies updated by the extraction */
+  melo_webplayer_grabber_worker_save (worker);
+
+  /* Report extraction time and memory kept by the process: it includes
+   * allocations of other workers running at the same time
+   */
+  MELO_LOGD ("worker %u resolved %s in %" G_GINT64_FORMAT
+             " ms (RSS: %+d KiB)",
+      worker->index, job->id_str, (g_get_monotonic_time () - start) / 1000,
+      (int) melo_webplayer_stats_get_rss () - (int) rss);
+
+  return stream;
+}
+
+static bool
+melo_webplayer_grabber_worker_begin (
+    MeloWebplayerGrabberWorker *worker, MeloWebplayerGrabberJob *job)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  bool stop;
+
+  /* Load and compile tasks run as a job which is only aborted on free: its
+   * ID matches no request and it cannot be preempted.
+   */
+  if (!job) {
+    job = &worker->task;
+    job->priority = MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY;
+    job->cancelled = false;
+  }
+
+  /* Job can be aborted from now */
+  g_mutex_lock (&worker->lock);
+  worker->job = job;
+  if (!++worker->run)
+    worker->run++;
+  g_mutex_unlock (&worker->lock);
+
+  /* Grabber is released: abort request may have been sent before */
+  g_mutex_lock (&grabber->mutex);
+  stop = grabber->stop;
+  g_mutex_unlock (&grabber->mutex);
+
+  return !stop;
+}
+
+static void
+melo_webplayer_grabber_worker_end (MeloWebplayerGrabberWorker *worker)
+{
+  /* Job cannot be aborted anymore */
+  g_mutex_lock (&worker->lock);
+  worker->job = NULL;
+  g_mutex_unlock (&worker->lock);
+}
+
+static MeloWebplayerStream *
+melo_webplayer_grabber_worker_delegate (MeloWebplayerGrabberWorker *worker,
+    MeloWebplayerGrabberTask task, MeloWebplayerGrabberJob *job)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  MeloWebplayerStream *stream = NULL;
+
+  /* Module updated: restart helper to import new version */
+  if (worker->helper && melo_webplayer_grabber_worker_outdated (worker)) {
+    MELO_LOGI ("restart helper of worker %u for new version", worker->index);
+    melo_webplayer_helper_free (worker->spare);
+    melo_webplayer_helper_free (worker->helper);
+    worker->spare = NULL;
+    worker->helper = NULL;
+  }
+
+  /* Start helper */
+  if (!worker->helper) {
+    worker->version = g_atomic_int_get (&grabber->version);
+    worker->helper = melo_webplayer_helper_new (
+        grabber->helper, grabber->path, grabber->cache_path);
+    if (!worker->helper)
+      return NULL;
+  }
+
+  /* Helper process is killed on abort */
+  if (melo_webplayer_grabber_worker_begin (worker, job)) {
+    if (task == MELO_WEBPLAYER_GRABBER_TASK_COMPILE)
+      melo_webplayer_helper_compile (worker->helper);
+    else if (task == MELO_WEBPLAYER_GRABBER_TASK_LOAD)
+      melo_webplayer_helper_load (worker->helper);
+    else if (job)
+      stream = melo_webplayer_helper_resolve (
+          worker->helper, job->url, job->id_str);
+  }
+  melo_webplayer_grabber_worker_end (worker);
+
+  return stream;
+}
+
+static void
+melo_webplayer_grabber_worker_recycle (MeloWebplayerGrabberWorker *worker)
+{
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  bool dead;
+
+  /* Helper is still usable, or restarted on next request for new version */
+  if (!worker->helper ||
+      !melo_webplayer_helper_is_worn (worker->helper,
+          MELO_WEBPLAYER_GRABBER_HELPER_MAX_RSS * 1024,
+          MELO_WEBPLAYER_GRABBER_HELPER_MAX_REQUESTS) ||
+      melo_webplayer_grabber_worker_outdated (worker))
+    return;
+
+  /* Pre-spawn replacement: worn helper serves requests while it loads */
+  if (!worker->spare) {
+    MELO_LOGI ("pre-spawn helper for worker %u", worker->index);
+    worker->spare = melo_webplayer_helper_new (
+        grabber->helper, grabber->path, grabber->cache_path);
+    if (worker->spare)
+      melo_webplayer_helper_load_async (worker->spare);
+  }
+
+  /* Retire helper once replacement is warm, or now if it is dead */
+  dead = !melo_webplayer_helper_is_ready (worker->helper, false);
+  if (worker->spare && !melo_webplayer_helper_is_ready (worker->spare, dead)) {
+    /* Still loading */
+    if (!melo_webplayer_helper_is_worn (worker->spare, 0, 0))
+      return;
+
+    /* Replacement failed: retry after next request */
+    melo_webplayer_helper_free (worker->spare);
+    worker->spare = NULL;
+  }
+  if (!worker->spare && !dead)
+    return;
+
+  MELO_LOGI ("recycle helper of worker %u", worker->index);
+  melo_webplayer_helper_free (worker->helper);
+  worker->helper = worker->spare;
+  worker->spare = NULL;
+}
+
+static gpointer
+melo_webplayer_grabber_thread_func (gpointer user_data)
+{
+  MeloWebplayerGrabberWorker *worker = user_data;
+  MeloWebplayerGrabber *grabber = worker->grabber;
+  MeloWebplayerGrabberTask task = MELO_WEBPLAYER_GRABBER_TASK_NONE;
+  MeloWebplayerGrabberJob *job;
+  bool initialized;
+
+  /* Python is initialized by first worker */
+  if (!worker->index)
+    melo_webplayer_grabber_init_python (grabber);
+
+  /* Wait Python initialization */
+  g_mutex_lock (&grabber->mutex);
+  while (!grabber->initialized)
+    g_cond_wait (&grabber->cond, &grabber->mutex);
+  g_mutex_unlock (&grabber->mutex);
+  initialized = Py_IsInitialized ();
+
+  /* Create worker interpreter */
+  if (initialized)
+    melo_webplayer_grabber_worker_init (worker);
+
+  /* Process jobs */
+  while ((job = melo_webplayer_grabber_pop (worker, &task)) != NULL ||
+         task != MELO_WEBPLAYER_GRABBER_TASK_NONE) {
+    MeloWebplayerStream *stream = NULL;
+
+    /* Load module and resolve stream */
+    if (grabber->helper) {
+      /* Delegate to helper process */
+      stream = melo_webplayer_grabber_worker_delegate (worker, task, job);
+    } else if (initialized) {
+      /* Switch to new module version between two requests */
+      bool reload = melo_webplayer_grabber_worker_outdated (worker);
+
+      melo_webplayer_grabber_worker_attach (worker);
+      if (reload)
+        melo_webplayer_grabber_worker_reload (worker);
+
+      /* Drop abort request of previous job */
+      worker->ident = PyThread_get_thread_ident ();
+      PyThreadState_SetAsyncExc (worker->ident, NULL);
+
+      /* Compilation and warm-up are aborted as jobs on free */
+      if (!melo_webplayer_grabber_worker_begin (worker, job)) {
+        /* Grabber is released */
+      } else if (task == MELO_WEBPLAYER_GRABBER_TASK_COMPILE) {
+        /* Compile module to bytecode */
+        melo_webplayer_grabber_worker_compile (worker);
+      } else if (melo_webplayer_grabber_worker_load (worker) && !job) {
+        /* Warm-up: check grabber is ready and pre-fetch player */
+        melo_webplayer_grabber_worker_check (worker);
+      } else if (worker->instance && job) {
+        melo_webplayer_grabber_worker_set_client (worker, job->client);
+        stream = melo_webplayer_grabber_worker_extract (worker, job);
+      }
+      melo_webplayer_grabber_worker_detach (worker);
+      melo_webplayer_grabber_worker_end (worker);
+    }
+
+    /* Compilation is done: load module */
+    if (task != MELO_WEBPLAYER_GRABBER_TASK_NONE) {
+      g_mutex_lock (&grabber->mutex);
+      if (task == MELO_WEBPLAYER_GRABBER_TASK_COMPILE)
+        grabber->compiling = false;
+      else
+        grabber->loading--;
+      g_cond_broadcast (&grabber->cond);
+      g_mutex_unlock (&grabber->mutex);
+    }
+
+    /* Release job, or queue preempted job again */
+    if (job && !(job->preempted && !stream &&
+                   melo_webplayer_grabber_requeue (grabber, job)))
+      melo_webplayer_grabber_job_free (grabber, job, stream);
+    task = MELO_WEBPLAYER_GRABBER_TASK_NONE;
+
+    /* Replace worn helper process */
+    melo_webplayer_grabber_worker_recycle (worker);
+  }
+
+  /* Release worker interpreter or helper process */
+  if (initialized)
+    melo_webplayer_grabber_worker_cleanup (worker);
+  melo_webplayer_helper_free (worker->spare);
+  melo_webplayer_helper_free (worker->helper);
+
+  /* Wait other workers */
+  g_mutex_lock (&grabber->mutex);
+  grabber->running--;
+  g_cond_broadcast (&grabber->cond);
+  while (!worker->index && grabber->running)
+    g_cond_wait (&grabber->cond, &grabber->mutex);
+  g_mutex_unlock (&grabber->mutex);
+
+  /* Finalize python */
+  if (!worker->index && grabber->finalize) {
+    PyEval_RestoreThread (grabber->main_tstate);
+    Py_Finalize ();
+  }
+
+  return NULL;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_GRABBER_H_
+#define _MELO_WEBPLAYER_GRABBER_H_
+
+#include "melo_webplayer_stream_cache.h"
+
+G_BEGIN_DECLS
+
+typedef struct _MeloWebplayerGrabber MeloWebplayerGrabber;
+
+/**
+ * MeloWebplayerGrabberPriority:
+ * @MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY: the stream is needed to play now, a
+ *     new request with this priority replaces all pending and running ones
+ *     and preempts a background job if no worker is idle; a slow YouTube job
+ *     is hedged on an idle worker with another player client
+ * @MELO_WEBPLAYER_GRABBER_PRIORITY_NEXT: the stream is the next one to play
+ * @MELO_WEBPLAYER_GRABBER_PRIORITY_PREFETCH: the stream is resolved
+ *     speculatively, only when no other job is pending
+ *
+ * Priority of a resolution request.
+ */
+typedef enum _MeloWebplayerGrabberPriority {
+  MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY = 0,
+  MELO_WEBPLAYER_GRABBER_PRIORITY_NEXT,
+  MELO_WEBPLAYER_GRABBER_PRIORITY_PREFETCH,
+
+  MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT,
+} MeloWebplayerGrabberPriority;
+
+/**
+ * MeloWebplayerGrabberCb:
+ * @stream: the resolved stream or NULL on failure, to free with
+ *     melo_webplayer_stream_free()
+ * @user_data: the user data passed to melo_webplayer_grabber_resolve()
+ *
+ * Called from a worker thread when a job is finished. It is called exactly
+ * once per request, even if the request has been dropped.
+ */
+typedef void (*MeloWebplayerGrabberCb) (
+    MeloWebplayerStream *stream, void *user_data);
+
+/**
+ * Create a new grabber.
+ *
+ * The grabber runs a pool of extraction workers, each one with its own
+ * grabber module instance. The Python module is loaded from the "output"
+ * directory of @path. Python is initialized on first job or load request.
+ *
+ * When @helper is set, Python is not embedded: each worker delegates to its
+ * own helper process, which is restarted when it uses too much memory or
+ * after a number of requests.
+ *
+ * @param path the grabber installation path
+ * @param cache_path the directory where bytecode, player data and cookies
+ *     are kept across restarts, can be NULL
+ * @param helper the helper program path, or NULL to run the grabber in the
+ *     calling process
+ * @param workers the number of extraction workers
+ * @return the newly grabber or NULL.
+ */
+MeloWebplayerGrabber *melo_webplayer_grabber_new (const char *path,
+    const char *cache_path, const char *helper, unsigned int workers);
+void melo_webplayer_grabber_free (MeloWebplayerGrabber *grabber);
+
+/**
+ * Select the extraction profile.
+ *
+ * The lean profile only extracts what is needed to get audio URLs, the full
+ * one keeps the grabber defaults. The default profile is set at build time.
+ * It must be called before the module is loaded, and it has no effect on
+ * helper processes.
+ *
+ * @param grabber the grabber
+ * @param lean %true to use the lean profile, %false for the full one
+ */
+void melo_webplayer_grabber_set_lean (
+    MeloWebplayerGrabber *grabber, bool lean);
+
+/**
+ * Load the grabber module in background.
+ *
+ * Python is initialized if needed, then all workers import the module,
+ * instantiate the grabber and run a self-check, so that the next jobs only
+ * pay for the extraction itself.
+ *
+ * @param grabber the grabber
+ */
+void melo_webplayer_grabber_load (MeloWebplayerGrabber *grabber);
+
+/**
+ * Compile the grabber module to bytecode in background.
+ *
+ * It should be called after each module update: the bytecode is stored in
+ * the cache directory so it can be used even if the module directory is not
+ * writable. Pending load requests are processed when compilation is done.
+ *
+ * Once compiled, the new module version is hot-reloaded: each worker
+ * re-imports it (or restarts its helper process) before its next request,
+ * while requests already running complete with the previous version.
+ *
+ * @param grabber the grabber
+ */
+void melo_webplayer_grabber_compile (MeloWebplayerGrabber *grabber);
+
+/**
+ * Wait end of load and compile requests.
+ *
+ * It blocks until the module is compiled and all workers have imported it
+ * and run their self-check, or until the grabber is released.
+ *
+ * @param grabber the grabber
+ */
+void melo_webplayer_grabber_wait (MeloWebplayerGrabber *grabber);
+
+/**
+ * Resolve audio stream of an URL.
+ *
+ * Requests of the same media share a single job, which runs with the highest
+ * priority of its requests.
+ *
+ * @param grabber the grabber
+ * @param url the media URL
+ * @param id the canonical ID of the media
+ * @param priority the job priority
+ * @param cb the function to call when the job is finished
+ * @param user_data the data to pass to @cb
+ * @return the request ID, or 0 if the request has not been queued.
+ */
+unsigned int melo_webplayer_grabber_resolve (MeloWebplayerGrabber *grabber,
+    const char *url, const char *id, MeloWebplayerGrabberPriority priority,
+    MeloWebplayerGrabberCb cb, void *user_data);
+
+/**
+ * Cancel a resolution request.
+ *
+ * When no other request shares its job, a pending job is dropped and a
+ * running job is aborted as soon as the grabber module returns to the
+ * interpreter, which is bounded by the network timeout. The request callback
+ * is still called, with a NULL stream.
+ *
+ * @param grabber the grabber
+ * @param id the request ID returned by melo_webplayer_grabber_resolve()
+ */
+void melo_webplayer_grabber_cancel (
+    MeloWebplayerGrabber *grabber, unsigned int id);
+
+/**
+ * Get the number of pending jobs.
+ *
+ * Time spent by jobs in queue is reported by the play path statistics.
+ *
+ * @param grabber the grabber
+ * @param priority the priority of jobs to count, or
+ *     %MELO_WEBPLAYER_GRABBER_PRIORITY_COUNT for all jobs
+ * @return the number of jobs waiting for a worker.
+ */
+unsigned int melo_webplayer_grabber_get_pending (
+    MeloWebplayerGrabber *grabber, MeloWebplayerGrabberPriority priority);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_GRABBER_H_ */
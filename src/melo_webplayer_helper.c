@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MELO_LOG_TAG "webplayer_helper"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_helper.h"
+
+/* Maximum size of a message */
+#define MELO_WEBPLAYER_HELPER_MAX_SIZE (64 * 1024)
+/* Size of message header: operation, bit-rate and RSS */
+#define MELO_WEBPLAYER_HELPER_HEADER_SIZE 13
+
+/* Time given to a helper to exit (in ms) */
+#define MELO_WEBPLAYER_HELPER_EXIT_TIMEOUT 1000
+
+struct _MeloWebplayerHelper {
+  GPid pid;
+  int in;
+  int out;
+  bool running;
+  bool pending;
+
+  unsigned int requests;
+  unsigned int rss;
+};
+
+static bool
+melo_webplayer_helper_write_all (int fd, const guint8 *data, size_t len)
+{
+  while (len) {
+    ssize_t ret = write (fd, data, len);
+
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      return false;
+    data += ret;
+    len -= ret;
+  }
+
+  return true;
+}
+
+static bool
+melo_webplayer_helper_read_all (int fd, void *buffer, size_t len)
+{
+  guint8 *data = buffer;
+
+  while (len) {
+    ssize_t ret = read (fd, data, len);
+
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      return false;
+    data += ret;
+    len -= ret;
+  }
+
+  return true;
+}
+
+bool
+melo_webplayer_helper_write (int fd, const MeloWebplayerHelperMessage *msg)
+{
+  GByteArray *array;
+  unsigned int i;
+  guint32 v = 0;
+  guint64 d;
+  bool ret;
+
+  /* Header: size (set later), operation, bit-rate and RSS */
+  array = g_byte_array_new ();
+  g_byte_array_append (array, (const guint8 *) &v, sizeof (v));
+  g_byte_array_append (array, &msg->op, 1);
+  memcpy (&d, &msg->bitrate, sizeof (d));
+  d = GUINT64_TO_LE (d);
+  g_byte_array_append (array, (const guint8 *) &d, sizeof (d));
+  v = GUINT32_TO_LE (msg->rss);
+  g_byte_array_append (array, (const guint8 *) &v, sizeof (v));
+
+  /* Strings with their NUL */
+  for (i = 0; i < msg->count && i < MELO_WEBPLAYER_HELPER_STRINGS; i++) {
+    const char *s = msg->strings[i] ? msg->strings[i] : "";
+
+    g_byte_array_append (array, (const guint8 *) s, strlen (s) + 1);
+  }
+
+  /* Set size */
+  v = GUINT32_TO_LE (array->len - sizeof (v));
+  memcpy (array->data, &v, sizeof (v));
+
+  ret = melo_webplayer_helper_write_all (fd, array->data, array->len);
+  g_byte_array_free (array, TRUE);
+
+  return ret;
+}
+
+bool
+melo_webplayer_helper_read (int fd, MeloWebplayerHelperMessage *msg)
+{
+  char *p, *end;
+  guint32 size;
+  guint64 d;
+
+  memset (msg, 0, sizeof (*msg));
+
+  /* Read size */
+  if (!melo_webplayer_helper_read_all (fd, &size, sizeof (size)))
+    return false;
+  size = GUINT32_FROM_LE (size);
+  if (size < MELO_WEBPLAYER_HELPER_HEADER_SIZE ||
+      size > MELO_WEBPLAYER_HELPER_MAX_SIZE) {
+    MELO_LOGE ("invalid message size: %u", size);
+    return false;
+  }
+
+  /* Read message: last string is always terminated */
+  msg->buffer = g_malloc (size + 1);
+  if (!melo_webplayer_helper_read_all (fd, msg->buffer, size)) {
+    melo_webplayer_helper_message_clear (msg);
+    return false;
+  }
+  msg->buffer[size] = '\0';
+
+  /* Parse header */
+  msg->op = msg->buffer[0];
+  memcpy (&d, msg->buffer + 1, sizeof (d));
+  d = GUINT64_FROM_LE (d);
+  memcpy (&msg->bitrate, &d, sizeof (d));
+  memcpy (&msg->rss, msg->buffer + 1 + sizeof (d), sizeof (msg->rss));
+  msg->rss = GUINT32_FROM_LE (msg->rss);
+
+  /* Split strings */
+  end = msg->buffer + size;
+  for (p = msg->buffer + MELO_WEBPLAYER_HELPER_HEADER_SIZE;
+       p < end && msg->count < MELO_WEBPLAYER_HELPER_STRINGS;
+       p += strlen (p) + 1)
+    msg->strings[msg->count++] = p;
+
+  return true;
+}
+
+void
+melo_webplayer_helper_message_clear (MeloWebplayerHelperMessage *msg)
+{
+  g_free (msg->buffer);
+  memset (msg, 0, sizeof (*msg));
+}
+
+MeloWebplayerHelper *
+melo_webplayer_helper_new (
+    const char *program, const char *path, const char *cache_path)
+{
+  char *argv[] = {(char *) program, (char *) path, (char *) cache_path, NULL};
+  MeloWebplayerHelper *helper;
+  GError *error = NULL;
+  sigset_t set;
+
+  /* Writing to a dead helper must not kill the daemon */
+  sigemptyset (&set);
+  sigaddset (&set, SIGPIPE);
+  pthread_sigmask (SIG_BLOCK, &set, NULL);
+
+  /* Start helper process */
+  helper = g_slice_new0 (MeloWebplayerHelper);
+  if (!g_spawn_async_with_pipes (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+          NULL, NULL, &helper->pid, &helper->in, &helper->out, NULL,
+          &error)) {
+    MELO_LOGE ("failed to start helper: %s", error->message);
+    g_slice_free (MeloWebplayerHelper, helper);
+    g_error_free (error);
+    return NULL;
+  }
+  helper->running = true;
+
+  MELO_LOGD ("helper %d started", helper->pid);
+
+  return helper;
+}
+
+void
+melo_webplayer_helper_free (MeloWebplayerHelper *helper)
+{
+  unsigned int i;
+
+  if (!helper)
+    return;
+
+  /* Close pipes: helper exits on end of file */
+  close (helper->in);
+  close (helper->out);
+
+  /* Wait helper exit, then kill it */
+  for (i = 0; i < MELO_WEBPLAYER_HELPER_EXIT_TIMEOUT / 10; i++) {
+    if (waitpid (helper->pid, NULL, WNOHANG))
+      break;
+    g_usleep (10000);
+  }
+  if (i == MELO_WEBPLAYER_HELPER_EXIT_TIMEOUT / 10) {
+    kill (helper->pid, SIGKILL);
+    waitpid (helper->pid, NULL, 0);
+  }
+  g_spawn_close_pid (helper->pid);
+
+  MELO_LOGD ("helper %d stopped after %u requests (RSS: %u KiB)", helper->pid,
+      helper->requests, helper->rss);
+
+  g_slice_free (MeloWebplayerHelper, helper);
+}
+
+bool
+melo_webplayer_helper_is_ready (MeloWebplayerHelper *helper, bool wait)
+{
+  struct pollfd fd = {.fd = helper->out, .events = POLLIN};
+  MeloWebplayerHelperMessage rep;
+
+  /* Read reply of pending request */
+  if (helper->running && helper->pending) {
+    if (!wait && poll (&fd, 1, 0) <= 0)
+      return false;
+
+    helper->pending = false;
+    if (!melo_webplayer_helper_read (helper->out, &rep)) {
+      MELO_LOGW ("helper %d stopped", helper->pid);
+      helper->running = false;
+      return false;
+    }
+    helper->rss = rep.rss;
+    melo_webplayer_helper_message_clear (&rep);
+  }
+
+  return helper->running;
+}
+
+static bool
+melo_webplayer_helper_call (MeloWebplayerHelper *helper,
+    const MeloWebplayerHelperMessage *req, MeloWebplayerHelperMessage *rep)
+{
+  /* Drop reply of asynchronous request */
+  melo_webplayer_helper_is_ready (helper, true);
+
+  /* Send request and wait reply */
+  if (!helper->running || !melo_webplayer_helper_write (helper->in, req) ||
+      !melo_webplayer_helper_read (helper->out, rep)) {
+    if (helper->running)
+      MELO_LOGW ("helper %d stopped", helper->pid);
+    helper->running = false;
+    return false;
+  }
+
+  /* Update helper memory */
+  helper->rss = rep->rss;
+
+  return rep->op == MELO_WEBPLAYER_HELPER_OP_OK;
+}
+
+bool
+melo_webplayer_helper_load (MeloWebplayerHelper *helper)
+{
+  MeloWebplayerHelperMessage req = {.op = MELO_WEBPLAYER_HELPER_OP_LOAD};
+  MeloWebplayerHelperMessage rep;
+  bool ret;
+
+  ret = melo_webplayer_helper_call (helper, &req, &rep);
+  melo_webplayer_helper_message_clear (&rep);
+
+  return ret;
+}
+
+bool
+melo_webplayer_helper_load_async (MeloWebplayerHelper *helper)
+{
+  MeloWebplayerHelperMessage req = {.op = MELO_WEBPLAYER_HELPER_OP_LOAD};
+
+  /* Send request: reply is read by melo_webplayer_helper_is_ready() */
+  if (!helper->running || helper->pending)
+    return false;
+  if (!melo_webplayer_helper_write (helper->in, &req)) {
+    MELO_LOGW ("helper %d stopped", helper->pid);
+    helper->running = false;
+    return false;
+  }
+  helper->pending = true;
+
+  return true;
+}
+
+bool
+melo_webplayer_helper_compile (MeloWebplayerHelper *helper)
+{
+  MeloWebplayerHelperMessage req = {.op = MELO_WEBPLAYER_HELPER_OP_COMPILE};
+  MeloWebplayerHelperMessage rep;
+  bool ret;
+
+  ret = melo_webplayer_helper_call (helper, &req, &rep);
+  melo_webplayer_helper_message_clear (&rep);
+
+  return ret;
+}
+
+MeloWebplayerStream *
+melo_webplayer_helper_resolve (
+    MeloWebplayerHelper *helper, const char *url, const char *id)
+{
+  MeloWebplayerHelperMessage req = {
+      .op = MELO_WEBPLAYER_HELPER_OP_RESOLVE,
+      .strings = {url, id},
+      .count = 2,
+  };
+  MeloWebplayerStream *stream = NULL;
+  MeloWebplayerHelperMessage rep;
+
+  /* Resolve stream */
+  helper->requests++;
+  if (melo_webplayer_helper_call (helper, &req, &rep) && rep.count == 3)
+    stream = melo_webplayer_stream_new (rep.strings[0], rep.strings[1],
+        *rep.strings[2] ? rep.strings[2] : NULL, rep.bitrate);
+  melo_webplayer_helper_message_clear (&rep);
+
+  return stream;
+}
+
+void
+melo_webplayer_helper_abort (MeloWebplayerHelper *helper)
+{
+  /* Kill helper: pending call fails on end of file */
+  if (helper && helper->running)
+    kill (helper->pid, SIGKILL);
+}
+
+bool
+melo_webplayer_helper_is_worn (MeloWebplayerHelper *helper,
+    unsigned int max_rss, unsigned int max_requests)
+{
+  return !helper->running || (max_rss && helper->rss >= max_rss) ||
+         (max_requests && helper->requests >= max_requests);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#ifndef _MELO_WEBPLAYER_HELPER_H_
+#define _MELO_WEBPLAYER_HELPER_H_
+
+#include <stdbool.h>
+
+#include "melo_webplayer_stream_cache.h"
+
+G_BEGIN_DECLS
+
+/* Maximum number of strings in a message */
+#define MELO_WEBPLAYER_HELPER_STRINGS 3
+
+typedef struct _MeloWebplayerHelper MeloWebplayerHelper;
+
+/**
+ * MeloWebplayerHelperOp:
+ * @MELO_WEBPLAYER_HELPER_OP_OK: the request succeeded
+ * @MELO_WEBPLAYER_HELPER_OP_FAIL: the request failed
+ * @MELO_WEBPLAYER_HELPER_OP_LOAD: load the grabber module
+ * @MELO_WEBPLAYER_HELPER_OP_COMPILE: compile the grabber module
+ * @MELO_WEBPLAYER_HELPER_OP_RESOLVE: resolve the URL (first string) of a
+ *     media (second string)
+ *
+ * Operation of a message exchanged with a helper.
+ */
+typedef enum _MeloWebplayerHelperOp {
+  MELO_WEBPLAYER_HELPER_OP_OK = 0,
+  MELO_WEBPLAYER_HELPER_OP_FAIL,
+  MELO_WEBPLAYER_HELPER_OP_LOAD,
+  MELO_WEBPLAYER_HELPER_OP_COMPILE,
+  MELO_WEBPLAYER_HELPER_OP_RESOLVE,
+} MeloWebplayerHelperOp;
+
+/**
+ * MeloWebplayerHelperMessage:
+ * @op: the message operation
+ * @bitrate: the stream bit-rate of a resolve reply (in kbps)
+ * @rss: the helper RSS of a reply (in KiB)
+ * @strings: the string arguments: a resolve reply holds the stream ID, URL
+ *     and codec
+ * @count: the number of strings
+ * @buffer: the buffer holding the strings of a received message
+ *
+ * A message exchanged with a helper. On the pipe, it is framed by its size,
+ * followed by the operation, the bit-rate as a little-endian IEEE 754 double,
+ * the RSS and the NUL-terminated strings.
+ */
+typedef struct {
+  guint8 op;
+  double bitrate;
+  guint32 rss;
+  const char *strings[MELO_WEBPLAYER_HELPER_STRINGS];
+  unsigned int count;
+  char *buffer;
+} MeloWebplayerHelperMessage;
+
+/**
+ * Write a message to a pipe.
+ *
+ * @param fd the file descriptor
+ * @param msg the message to write
+ * @return %true if the message has been written, %false otherwise.
+ */
+bool melo_webplayer_helper_write (
+    int fd, const MeloWebplayerHelperMessage *msg);
+
+/**
+ * Read a message from a pipe.
+ *
+ * The message must be released with melo_webplayer_helper_message_clear().
+ *
+ * @param fd the file descriptor
+ * @param msg the message to fill
+ * @return %true if a message has been read, %false on error or end of file.
+ */
+bool melo_webplayer_helper_read (int fd, MeloWebplayerHelperMessage *msg);
+void melo_webplayer_helper_message_clear (MeloWebplayerHelperMessage *msg);
+
+/**
+ * Start a new helper process.
+ *
+ * The helper runs a grabber in its own process, so the grabber memory and
+ * crashes do not affect the daemon. The helper must only be used from the
+ * calling thread, where SIGPIPE is blocked.
+ *
+ * @param program the helper program path
+ * @param path the grabber installation path
+ * @param cache_path the grabber cache path, can be NULL
+ * @return the newly helper or NULL.
+ */
+MeloWebplayerHelper *melo_webplayer_helper_new (
+    const char *program, const char *path, const char *cache_path);
+
+/**
+ * Stop a helper.
+ *
+ * The helper is given some time to exit, then it is killed.
+ *
+ * @param helper the helper
+ */
+void melo_webplayer_helper_free (MeloWebplayerHelper *helper);
+
+bool melo_webplayer_helper_load (MeloWebplayerHelper *helper);
+bool melo_webplayer_helper_compile (MeloWebplayerHelper *helper);
+
+/**
+ * Load the grabber module without waiting.
+ *
+ * The helper keeps loading in background: the end of the load is detected
+ * with melo_webplayer_helper_is_ready().
+ *
+ * @param helper the helper
+ * @return %true if the request has been sent, %false otherwise.
+ */
+bool melo_webplayer_helper_load_async (MeloWebplayerHelper *helper);
+
+/**
+ * Check if a helper is ready for a new request.
+ *
+ * @param helper the helper
+ * @param wait %true to wait the end of a pending asynchronous request
+ * @return %true if the helper is running and has no pending request.
+ */
+bool melo_webplayer_helper_is_ready (MeloWebplayerHelper *helper, bool wait);
+
+/**
+ * Resolve audio stream of an URL.
+ *
+ * This function blocks until the helper replies.
+ *
+ * @param helper the helper
+ * @param url the media URL
+ * @param id the canonical ID of the media
+ * @return the resolved stream or NULL.
+ */
+MeloWebplayerStream *melo_webplayer_helper_resolve (
+    MeloWebplayerHelper *helper, const char *url, const char *id);
+
+/**
+ * Abort the current request.
+ *
+ * The helper is killed, so the pending call fails immediately. This function
+ * can be called from any thread while the helper is in use.
+ *
+ * @param helper the helper
+ */
+void melo_webplayer_helper_abort (MeloWebplayerHelper *helper);
+
+/**
+ * Check if a helper should be replaced.
+ *
+ * @param helper the helper
+ * @param max_rss the RSS limit (in KiB), 0 for no limit
+ * @param max_requests the request count limit, 0 for no limit
+ * @return %true if the helper is dead or passed one of the limits.
+ */
+bool melo_webplayer_helper_is_worn (MeloWebplayerHelper *helper,
+    unsigned int max_rss, unsigned int max_requests);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_HELPER_H_ */
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define MELO_LOG_TAG "webplayer_helper"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_grabber.h"
+#include "melo_webplayer_helper.h"
+#include "melo_webplayer_stats.h"
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  bool done;
+  MeloWebplayerStream *stream;
+} MeloWebplayerHelperResult;
+
+static void
+resolve_cb (MeloWebplayerStream *stream, void *user_data)
+{
+  MeloWebplayerHelperResult *result = user_data;
+
+  /* Wake up main thread */
+  g_mutex_lock (&result->mutex);
+  result->stream = stream;
+  result->done = true;
+  g_cond_signal (&result->cond);
+  g_mutex_unlock (&result->mutex);
+}
+
+static MeloWebplayerStream *
+melo_webplayer_helper_main_resolve (
+    MeloWebplayerGrabber *grabber, const char *url, const char *id)
+{
+  MeloWebplayerHelperResult result = {0};
+
+  g_mutex_init (&result.mutex);
+  g_cond_init (&result.cond);
+
+  /* Resolve stream and wait result */
+  melo_webplayer_grabber_resolve (grabber, url, id,
+      MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY, resolve_cb, &result);
+  g_mutex_lock (&result.mutex);
+  while (!result.done)
+    g_cond_wait (&result.cond, &result.mutex);
+  g_mutex_unlock (&result.mutex);
+
+  g_cond_clear (&result.cond);
+  g_mutex_clear (&result.mutex);
+
+  return result.stream;
+}
+
+int
+main (int argc, char *argv[])
+{
+  MeloWebplayerHelperMessage req;
+  MeloWebplayerGrabber *grabber;
+  int out;
+
+  if (argc < 2) {
+    fprintf (stderr, "usage: %s PATH [CACHE_PATH]\n", argv[0]);
+    return 1;
+  }
+
+  /* Keep standard output for replies: grabber output goes to error output */
+  out = dup (STDOUT_FILENO);
+  dup2 (STDERR_FILENO, STDOUT_FILENO);
+
+  /* The daemon runs one helper per worker */
+  grabber = melo_webplayer_grabber_new (
+      argv[1], argc > 2 ? argv[2] : NULL, NULL, 1);
+
+  /* Process requests */
+  while (melo_webplayer_helper_read (STDIN_FILENO, &req)) {
+    MeloWebplayerHelperMessage rep = {.op = MELO_WEBPLAYER_HELPER_OP_OK};
+    MeloWebplayerStream *stream = NULL;
+
+    switch (req.op) {
+    case MELO_WEBPLAYER_HELPER_OP_LOAD:
+      /* Reply when done: the daemon may restart helper just after */
+      melo_webplayer_grabber_load (grabber);
+      melo_webplayer_grabber_wait (grabber);
+      break;
+    case MELO_WEBPLAYER_HELPER_OP_COMPILE:
+      melo_webplayer_grabber_compile (grabber);
+      melo_webplayer_grabber_wait (grabber);
+      break;
+    case MELO_WEBPLAYER_HELPER_OP_RESOLVE:
+      if (req.count == 2)
+        stream = melo_webplayer_helper_main_resolve (
+            grabber, req.strings[0], req.strings[1]);
+      if (stream) {
+        rep.bitrate = stream->bitrate;
+        rep.strings[0] = stream->id;
+        rep.strings[1] = stream->url;
+        rep.strings[2] = stream->codec;
+        rep.count = 3;
+      } else
+        rep.op = MELO_WEBPLAYER_HELPER_OP_FAIL;
+      break;
+    default:
+      rep.op = MELO_WEBPLAYER_HELPER_OP_FAIL;
+    }
+
+    /* Send reply with current memory usage */
+    rep.rss = melo_webplayer_stats_get_rss ();
+    if (!melo_webplayer_helper_write (out, &rep))
+      break;
+
+    melo_webplayer_stream_free (stream);
+    melo_webplayer_helper_message_clear (&req);
+  }
+
+  /* Daemon is gone: state is saved after each request, so exit now without
+   * finalizing Python
+   */
+  _exit (0);
+}
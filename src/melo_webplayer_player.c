@@ -15,21 +15,68 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
  */
 
-#include <Python.h>
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
 
 #include <melo/melo_http_client.h>
 
 #define MELO_LOG_TAG "webplayer_player"
 #include <melo/melo_log.h>
 
+#include "config.h"
+
+#include "melo_webplayer_audio_cache.h"
+#include "melo_webplayer_grabber.h"
+#include "melo_webplayer_stats.h"
 #include "melo_webplayer_player.h"
+#include "melo_webplayer_stream_cache.h"
+#include "melo_webplayer_unzip.h"
 
 #define MELO_WEBPLAYER_PLAYER_GRABBER "yt-dlp"
 #define MELO_WEBPLAYER_PLAYER_GRABBER_VERSION "version"
-
 #define MELO_WEBPLAYER_PLAYER_GRABBER_PATH "output"
-#define MELO_WEBPLAYER_PLAYER_GRABBER_MODULE "yt_dlp"
-#define MELO_WEBPLAYER_PLAYER_GRABBER_CLASS "YoutubeDL"
+
+/* Update schedule and release validators, next to version file */
+#define MELO_WEBPLAYER_PLAYER_GRABBER_STATE "update"
+#define MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP "update"
+/* HTTP user agent, completed by libsoup with its version */
+#define MELO_WEBPLAYER_PLAYER_USER_AGENT "Melo "
+
+/* Interval between two grabber version checks (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_UPDATE_INTERVAL (12 * 60 * 60)
+/* Minimal delay before a version check, out of daemon startup (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_UPDATE_DELAY 60
+/* Delay before first retry of a failed update, then doubled (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_UPDATE_RETRY (5 * 60)
+/* Maximum random delay added to a version check (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_UPDATE_JITTER (10 * 60)
+
+#define MELO_WEBPLAYER_PLAYER_STREAM_CACHE "streams"
+#define MELO_WEBPLAYER_PLAYER_STREAM_CACHE_SIZE 128
+#define MELO_WEBPLAYER_PLAYER_AUDIO_CACHE "audio"
+
+/* Run grabber in helper processes */
+#ifdef MELO_WEBPLAYER_GRABBER_HELPER
+#define MELO_WEBPLAYER_PLAYER_HELPER MELO_WEBPLAYER_GRABBER_HELPER
+#else
+#define MELO_WEBPLAYER_PLAYER_HELPER NULL
+#endif
+
+#define MELO_WEBPLAYER_PLAYER_PREFETCH_COUNT 3
+#define MELO_WEBPLAYER_PLAYER_PREFETCH_MAX 32
+
+/* Delay before grabber warm-up after module enable (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_WARMUP_DELAY 5
+
+/* Maximum time to resolve a stream to play (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_DEADLINE 15
+
+/* Maximum recovery attempts of a failed stream */
+#define MELO_WEBPLAYER_PLAYER_RECOVER_MAX 3
+/* Time without progress before a stream is considered stalled (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_STALL_TIMEOUT 10
+/* Minimal remaining time for an EOS to be considered premature (in seconds) */
+#define MELO_WEBPLAYER_PLAYER_EOS_MARGIN 5
 
 #define MELO_WEBPLAYER_PLAYER_GRABBER_LATEST_URL \
   "github.com/yt-dlp/yt-dlp/releases/latest/" \
@@ -44,36 +91,100 @@ struct _MeloWebplayerPlayer {
   GstElement *src;
   guint bus_id;
 
-  char *path;
+  bool gapless;
+  char *next_url;
+  char *gapless_url;
 
-  MeloHttpClient *client;
-  gint64 last_update;
+  char *path;
+  char *cache_path;
+
+  MeloWebplayerStreamCache *cache;
+  MeloWebplayerAudioCache *audio_cache;
+  GHashTable *recordings;
+
+  gint64 last_check;
+  char *etag;
+  char *modified;
+  char *new_etag;
+  char *new_modified;
+  unsigned int failures;
+  gint64 retry_time;
+  guint update_id;
   bool use_https;
   bool updating;
+  bool installed;
   char *version;
   char *url;
 
-  GSubprocess *process;
+  SoupSession *session;
+  SoupMessage *msg;
+  GCancellable *cancellable;
 
-  GThread *thread;
+  MeloWebplayerGrabber *grabber;
+  guint warmup_id;
+  GMutex mutex;
   bool stop;
-  GAsyncQueue *queue;
-
-  guint monitor_id;
+  unsigned int serial;
+  guint result_id;
+
+  unsigned int job_id;
+  char *job_stream_id;
+  guint deadline_id;
+
+  char *media_url;
+  char *media_id;
+  bool local;
+  unsigned int recover_count;
+  gint64 recover_start;
+  gint64 resume_position;
+  guint stall_id;
+  gint64 stall_position;
+  unsigned int stall_count;
+
+  gint64 play_start;
+  gint64 preroll_start;
+  gint first_audio;
+
+  GQueue prefetch;
 };
 
-MELO_DEFINE_PLAYER (MeloWebplayerPlayer, melo_webplayer_player)
+typedef struct {
+  char *url;
+  char *prev;
+  bool done;
+} MeloWebplayerPlayerPrefetch;
+
+typedef struct {
+  MeloWebplayerPlayer *player;
+  MeloWebplayerStream *stream;
+  unsigned int serial;
+  bool prefetch;
+  char *url;
+} MeloWebplayerPlayerJob;
 
-static char *melo_webplayer_player_empty_url = "";
+MELO_DEFINE_PLAYER (MeloWebplayerPlayer, melo_webplayer_player)
 
-static void network_changed_cb (
-    GNetworkMonitor *monitor, gboolean network_available, gpointer user_data);
 static gboolean bus_cb (GstBus *bus, GstMessage *msg, gpointer data);
 static void pad_added_cb (GstElement *src, GstPad *pad, GstElement *sink);
-
+static gint select_stream_cb (GstElement *src,
+    GstStreamCollection *collection, GstStream *stream, gpointer user_data);
+static void about_to_finish_cb (GstElement *src, gpointer user_data);
+static void source_setup_cb (
+    GstElement *src, GstElement *source, gpointer user_data);
+static GstPadProbeReturn first_audio_probe_cb (
+    GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+
+static gboolean warmup_cb (gpointer user_data);
+static void melo_webplayer_player_load_state (MeloWebplayerPlayer *player);
+static void melo_webplayer_player_schedule_update (
+    MeloWebplayerPlayer *player);
 static void melo_webplayer_player_update_grabber (MeloWebplayerPlayer *player);
+static bool melo_webplayer_player_recover (
+    MeloWebplayerPlayer *player, const char *reason);
 
-static gpointer melo_webplayer_player_thread_func (gpointer user_data);
+static void melo_webplayer_player_prefetch_free (gpointer data);
+static void melo_webplayer_player_schedule_prefetch (
+    MeloWebplayerPlayer *player);
 
 static bool melo_webplayer_player_play (MeloPlayer *player, const char *url);
 static bool melo_webplayer_player_set_state (
@@ -87,11 +198,25 @@ melo_webplayer_player_finalize (GObject *object)
 {
   MeloWebplayerPlayer *player = MELO_WEBPLAYER_PLAYER (object);
 
-  /* Stop running process */
-  if (player->process) {
-    g_subprocess_force_exit (player->process);
-    g_object_unref (player->process);
-  }
+  /* Stop pipeline first: streaming threads use player data */
+  gst_element_set_state (player->pipeline, GST_STATE_NULL);
+
+  /* Abort running download or extraction */
+  g_cancellable_cancel (player->cancellable);
+  g_object_unref (player->cancellable);
+  if (player->msg)
+    g_object_unref (player->msg);
+  g_object_unref (player->session);
+
+  /* Remove next version check */
+  if (player->update_id)
+    g_source_remove (player->update_id);
+
+  /* Free version validators */
+  g_free (player->new_modified);
+  g_free (player->new_etag);
+  g_free (player->modified);
+  g_free (player->etag);
 
   /* Free pending URL */
   g_free (player->url);
@@ -99,31 +224,57 @@ melo_webplayer_player_finalize (GObject *object)
   /* Free version string */
   g_free (player->version);
 
-  /* Release HTTP client */
-  g_object_unref (player->client);
+  /* Remove pending warm-up */
+  if (player->warmup_id)
+    g_source_remove (player->warmup_id);
 
-  /* Stop thread */
+  /* Stop and release grabber: pending results are dropped */
+  g_mutex_lock (&player->mutex);
   player->stop = true;
-  g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
-  g_thread_join (player->thread);
-
-  /* Release queue */
-  g_async_queue_unref (player->queue);
-
-  /* Free path */
+  g_mutex_unlock (&player->mutex);
+  melo_webplayer_grabber_free (player->grabber);
+
+  /* Remove pending result */
+  if (player->result_id)
+    g_source_remove (player->result_id);
+  if (player->deadline_id)
+    g_source_remove (player->deadline_id);
+  g_free (player->job_stream_id);
+
+  /* Remove stall detection */
+  if (player->stall_id)
+    g_source_remove (player->stall_id);
+  g_free (player->media_id);
+  g_free (player->media_url);
+
+  /* Release prefetch list */
+  g_queue_clear_full (&player->prefetch, melo_webplayer_player_prefetch_free);
+  g_mutex_clear (&player->mutex);
+
+  /* Report play path timings */
+  melo_webplayer_stats_dump ();
+
+  /* Free gapless URLs */
+  g_free (player->gapless_url);
+  g_free (player->next_url);
+
+  /* Release stream cache */
+  melo_webplayer_stream_cache_free (player->cache);
+
+  /* Free paths */
+  g_free (player->cache_path);
   g_free (player->path);
 
-  /* Remove network monitor */
-  if (player->monitor_id)
-    g_source_remove (player->monitor_id);
-
   /* Remove bus watcher */
   g_source_remove (player->bus_id);
 
-  /* Stop and release pipeline */
-  gst_element_set_state (player->pipeline, GST_STATE_NULL);
+  /* Release pipeline */
   gst_object_unref (player->pipeline);
 
+  /* Release audio cache: it is freed with the last recording */
+  g_hash_table_unref (player->recordings);
+  melo_webplayer_audio_cache_free (player->audio_cache);
+
   /* Chain finalize */
   G_OBJECT_CLASS (melo_webplayer_player_parent_class)->finalize (object);
 }
@@ -147,24 +298,52 @@ melo_webplayer_player_class_init (MeloWebplayerPlayerClass *klass)
 static void
 melo_webplayer_player_init (MeloWebplayerPlayer *self)
 {
-  GNetworkMonitor *monitor;
   GstElement *sink;
+  char *path;
   GstCaps *caps;
   GstBus *bus;
+  GstPad *pad;
 
-  /* Create pipeline */
+  /* Create pipeline: use a source able to chain streams when available */
   self->pipeline = gst_pipeline_new (MELO_WEBPLAYER_PLAYER_ID "_pipeline");
   self->src = gst_element_factory_make (
-      "uridecodebin", MELO_WEBPLAYER_PLAYER_ID "_src");
+      "uridecodebin3", MELO_WEBPLAYER_PLAYER_ID "_src");
+  if (self->src)
+    self->gapless = true;
+  else
+    self->src = gst_element_factory_make (
+        "uridecodebin", MELO_WEBPLAYER_PLAYER_ID "_src");
   sink = melo_player_get_sink (
       MELO_PLAYER (self), MELO_WEBPLAYER_PLAYER_ID "_sink");
   gst_bin_add_many (GST_BIN (self->pipeline), self->src, sink, NULL);
 
   /* Handle only audio tracks */
   caps = gst_caps_from_string ("audio/x-raw(ANY)");
-  g_object_set (self->src, "caps", caps, "expose-all-streams", FALSE, NULL);
+  if (self->gapless) {
+    g_object_set (self->src, "caps", caps, NULL);
+    g_signal_connect (
+        self->src, "select-stream", G_CALLBACK (select_stream_cb), NULL);
+  } else
+    g_object_set (self->src, "caps", caps, "expose-all-streams", FALSE, NULL);
   gst_caps_unref (caps);
 
+  /* Pre-roll next stream before end of current one */
+  if (self->gapless)
+    g_signal_connect (
+        self->src, "about-to-finish", G_CALLBACK (about_to_finish_cb), self);
+
+  /* Record streams to audio cache */
+  g_signal_connect (
+      self->src, "source-setup", G_CALLBACK (source_setup_cb), self);
+
+  /* Measure time to first audio */
+  pad = gst_element_get_static_pad (sink, "sink");
+  if (pad) {
+    gst_pad_add_probe (
+        pad, GST_PAD_PROBE_TYPE_BUFFER, first_audio_probe_cb, self, NULL);
+    gst_object_unref (pad);
+  }
+
   /* Add signal handler on new pad */
   g_signal_connect (self->src, "pad-added", G_CALLBACK (pad_added_cb), sink);
 
@@ -179,27 +358,63 @@ melo_webplayer_player_init (MeloWebplayerPlayer *self)
   if (self->path)
     g_mkdir_with_parents (self->path, 0700);
 
-  /* Create async queue */
-  self->queue = g_async_queue_new_full (g_free);
-
-  /* Start thread */
-  self->thread = g_thread_new (
-      "webplayer_thread", melo_webplayer_player_thread_func, self);
-
-  /* Create HTTP client */
-  self->client = melo_http_client_new (NULL);
+  /* Create cache path */
+  self->cache_path = g_build_filename (
+      g_get_user_data_dir (), "melo", "webplayer", "cache", NULL);
+  if (self->cache_path)
+    g_mkdir_with_parents (self->cache_path, 0700);
+
+  /* Create resolved stream cache */
+  path = g_build_filename (
+      self->cache_path, MELO_WEBPLAYER_PLAYER_STREAM_CACHE, NULL);
+  self->cache = melo_webplayer_stream_cache_new (
+      path, MELO_WEBPLAYER_PLAYER_STREAM_CACHE_SIZE);
+  g_free (path);
+
+  /* Create audio cache */
+  path = g_build_filename (
+      self->cache_path, MELO_WEBPLAYER_PLAYER_AUDIO_CACHE, NULL);
+  self->audio_cache = melo_webplayer_audio_cache_new (
+      path, (guint64) MELO_WEBPLAYER_AUDIO_CACHE_SIZE * 1024 * 1024);
+  self->recordings =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_free (path);
+
+  /* Create prefetch list */
+  g_mutex_init (&self->mutex);
+  g_queue_init (&self->prefetch);
+
+  /* No position to resume on first play */
+  self->resume_position = -1;
+
+  /* Start grabber workers */
+  self->grabber = melo_webplayer_grabber_new (self->path, self->cache_path,
+      MELO_WEBPLAYER_PLAYER_HELPER, MELO_WEBPLAYER_GRABBER_WORKERS);
+
+  /* Warm-up grabber when daemon is idle */
+  self->warmup_id = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+      MELO_WEBPLAYER_PLAYER_WARMUP_DELAY, warmup_cb, self, NULL);
+
+  /* Current grabber version is used until an update is installed */
+  path = g_build_filename (
+      self->path, MELO_WEBPLAYER_PLAYER_GRABBER_VERSION, NULL);
+  self->installed = g_file_test (path, G_FILE_TEST_EXISTS);
+  g_free (path);
+
+  /* Create HTTP session */
+  self->session = soup_session_new_with_options (
+      SOUP_SESSION_USER_AGENT, MELO_WEBPLAYER_PLAYER_USER_AGENT, NULL);
+  self->cancellable = g_cancellable_new ();
 
   /* Use HTTPS by default */
   self->use_https = true;
 
-  /* Start grabber update */
-  melo_webplayer_player_update_grabber (self);
-
-  /* Add netowrk monitoring to check for update */
-  monitor = g_network_monitor_get_default ();
-  if (monitor)
-    self->monitor_id = g_signal_connect (
-        monitor, "network-changed", G_CALLBACK (network_changed_cb), self);
+  /* Install grabber now, otherwise check for update later */
+  melo_webplayer_player_load_state (self);
+  if (!self->installed)
+    melo_webplayer_player_update_grabber (self);
+  else
+    melo_webplayer_player_schedule_update (self);
 }
 
 MeloWebplayerPlayer *
@@ -211,52 +426,217 @@ melo_webplayer_player_new ()
       "fab:youtube", NULL);
 }
 
+static gboolean
+warmup_cb (gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+
+  /* Load grabber in background, unless first install is in progress */
+  player->warmup_id = 0;
+  if (!player->updating || player->installed)
+    melo_webplayer_grabber_load (player->grabber);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
-network_changed_cb (
-    GNetworkMonitor *monitor, gboolean network_available, gpointer user_data)
+melo_webplayer_player_load_state (MeloWebplayerPlayer *player)
+{
+  GKeyFile *kf;
+  char *file;
+
+  /* Load last check time and validators of installed release */
+  file = g_build_filename (
+      player->path, MELO_WEBPLAYER_PLAYER_GRABBER_STATE, NULL);
+  kf = g_key_file_new ();
+  if (g_key_file_load_from_file (kf, file, G_KEY_FILE_NONE, NULL)) {
+    player->last_check = g_key_file_get_int64 (
+        kf, MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP, "last-check", NULL);
+    player->etag = g_key_file_get_string (
+        kf, MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP, "etag", NULL);
+    player->modified = g_key_file_get_string (
+        kf, MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP, "last-modified", NULL);
+  }
+  g_key_file_free (kf);
+  g_free (file);
+}
+
+static void
+melo_webplayer_player_save_state (MeloWebplayerPlayer *player)
+{
+  GError *error = NULL;
+  GKeyFile *kf;
+  char *file;
+
+  /* Set last check time and validators */
+  kf = g_key_file_new ();
+  g_key_file_set_int64 (kf, MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP,
+      "last-check", player->last_check);
+  if (player->etag)
+    g_key_file_set_string (kf, MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP,
+        "etag", player->etag);
+  if (player->modified)
+    g_key_file_set_string (kf, MELO_WEBPLAYER_PLAYER_GRABBER_STATE_GROUP,
+        "last-modified", player->modified);
+
+  /* Save state file, next to version file */
+  file = g_build_filename (
+      player->path, MELO_WEBPLAYER_PLAYER_GRABBER_STATE, NULL);
+  if (!g_key_file_save_to_file (kf, file, &error)) {
+    MELO_LOGW ("failed to save update state: %s", error->message);
+    g_error_free (error);
+  }
+  g_key_file_free (kf);
+  g_free (file);
+}
+
+static gboolean
+update_timeout_cb (gpointer user_data)
 {
   MeloWebplayerPlayer *player = user_data;
 
-  /* Network not available */
-  if (!network_available)
-    return;
+  /* Check for new version */
+  player->update_id = 0;
+  melo_webplayer_player_update_grabber (player);
 
-  /* Last update done 30s before */
-  if (g_get_monotonic_time () - player->last_update < 5 * 60000000)
-    return;
+  return G_SOURCE_REMOVE;
+}
 
-  /* Trigger update */
-  if (!player->updating)
-    melo_webplayer_player_update_grabber (player);
+static void
+melo_webplayer_player_schedule_update (MeloWebplayerPlayer *player)
+{
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC, delay;
+
+  /* Remove pending check */
+  if (player->update_id)
+    g_source_remove (player->update_id);
+
+  /* Retry failed update with an exponential backoff, or check periodically */
+  if (player->failures)
+    delay = (gint64) MELO_WEBPLAYER_PLAYER_UPDATE_RETRY
+            << MIN (player->failures - 1, 8);
+  else
+    delay = player->last_check + MELO_WEBPLAYER_PLAYER_UPDATE_INTERVAL - now;
+  delay = CLAMP (delay, MELO_WEBPLAYER_PLAYER_UPDATE_DELAY,
+      MELO_WEBPLAYER_PLAYER_UPDATE_INTERVAL);
+
+  /* Wait end of server rate limit */
+  if (player->retry_time > now + delay)
+    delay = player->retry_time - now;
+
+  /* Spread checks over time */
+  delay += g_random_int_range (0, MELO_WEBPLAYER_PLAYER_UPDATE_JITTER);
+
+  MELO_LOGD ("next version check in %" G_GINT64_FORMAT " s", delay);
+  player->update_id = g_timeout_add_seconds_full (
+      G_PRIORITY_LOW, delay, update_timeout_cb, player, NULL);
+}
+
+static bool
+melo_webplayer_player_rate_limit (
+    MeloWebplayerPlayer *player, SoupMessage *msg)
+{
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+  const char *value;
+
+  /* Not rate limited */
+  player->retry_time = 0;
+  if (msg->status_code != SOUP_STATUS_FORBIDDEN &&
+      msg->status_code != SOUP_STATUS_TOO_MANY_REQUESTS)
+    return false;
+
+  /* Delay requested by server (in seconds) */
+  value = soup_message_headers_get_one (msg->response_headers, "Retry-After");
+  if (value)
+    player->retry_time = now + g_ascii_strtoll (value, NULL, 10);
+
+  /* Requests quota exhausted: wait its reset time */
+  value = soup_message_headers_get_one (
+      msg->response_headers, "X-RateLimit-Remaining");
+  if (value && !strcmp (value, "0")) {
+    value = soup_message_headers_get_one (
+        msg->response_headers, "X-RateLimit-Reset");
+    if (value)
+      player->retry_time =
+          MAX (player->retry_time, g_ascii_strtoll (value, NULL, 10));
+  }
+
+  if (player->retry_time <= now)
+    return false;
+
+  MELO_LOGW ("rate limited for %" G_GINT64_FORMAT " s",
+      player->retry_time - now);
+  return true;
+}
+
+static void
+melo_webplayer_player_update_done (MeloWebplayerPlayer *player, bool success)
+{
+  /* Update is finished */
+  player->updating = false;
+
+  /* Save check time and validators of installed release */
+  if (success) {
+    player->last_check = g_get_real_time () / G_USEC_PER_SEC;
+    player->failures = 0;
+    if (player->new_etag || player->new_modified) {
+      g_free (player->etag);
+      g_free (player->modified);
+      player->etag = player->new_etag;
+      player->modified = player->new_modified;
+      player->new_etag = player->new_modified = NULL;
+    }
+    melo_webplayer_player_save_state (player);
+  } else
+    player->failures++;
+
+  /* Drop validators of a release not installed */
+  g_free (player->new_etag);
+  g_free (player->new_modified);
+  player->new_etag = player->new_modified = NULL;
+
+  /* Schedule next check */
+  melo_webplayer_player_schedule_update (player);
+
+  /* Play pending URL */
+  if (player->url) {
+    melo_webplayer_player_play (MELO_PLAYER (player), player->url);
+    g_free (player->url);
+    player->url = NULL;
+  } else if (!player->warmup_id)
+    melo_webplayer_grabber_load (player->grabber);
+
+  /* Resolve next playlist entries */
+  melo_webplayer_player_schedule_prefetch (player);
 }
 
 static void
 unzip_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
-  GSubprocess *subprocess = G_SUBPROCESS (source_object);
   MeloWebplayerPlayer *player = user_data;
   GError *error = NULL;
   char *file = NULL;
-  gint status;
+  bool ret;
+
+  /* Extraction finished */
+  ret = melo_webplayer_unzip_extract_finish (res, &error);
+  if (!ret) {
+    /* Player has been released */
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free (error);
+      return;
+    }
 
-  /* Unzip finished */
-  if (!g_subprocess_wait_finish (subprocess, res, &error)) {
     MELO_LOGE ("failed to unzip: %s", error->message);
-    g_error_free (error);
-    goto end;
+    g_clear_error (&error);
   }
 
   /* Create version file path */
   file = g_build_filename (
       player->path, MELO_WEBPLAYER_PLAYER_GRABBER_VERSION, NULL);
 
-  /* Get status */
-  status = g_subprocess_get_exit_status (subprocess);
-
-  MELO_LOGD ("unzip exited with %d", status);
-
   /* Check status */
-  if (!status || status == 1) {
+  if (ret) {
     /* Use null version */
     if (!player->version)
       player->version = g_strdup ("0.0.0");
@@ -266,11 +646,14 @@ unzip_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
             file, player->version, strlen (player->version), &error)) {
       MELO_LOGE ("failed to save version file: %s", error->message);
       g_error_free (error);
+      ret = false;
       goto end;
     }
 
-    /* Update is done */
+    /* Update is done: compile new version, workers switch to it */
     MELO_LOGI ("latest version installed");
+    player->installed = true;
+    melo_webplayer_grabber_compile (player->grabber);
   } else {
     gchar *version;
     gsize len;
@@ -287,99 +670,144 @@ unzip_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
   }
 
 end:
-  /* Free process */
-  g_object_unref (subprocess);
-  player->process = NULL;
-
   /* Free string */
   g_free (file);
-  player->updating = false;
-
-  /* Save last update timestamp */
-  player->last_update = g_get_monotonic_time ();
 
-  /* Play pending URL */
-  if (player->url) {
-    melo_webplayer_player_play (MELO_PLAYER (player), player->url);
-    g_free (player->url);
-    player->url = NULL;
-  } else
-    g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
+  /* Update is done */
+  melo_webplayer_player_update_done (player, ret);
 }
 
 static void
-update_cb (MeloHttpClient *client, unsigned int code, const char *data,
-    size_t size, void *user_data)
+splice_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
+  GOutputStream *stream = G_OUTPUT_STREAM (source_object);
   MeloWebplayerPlayer *player = user_data;
   GError *error = NULL;
   char *file, *output;
-
-  /* Failed to download update */
-  if (code != 200) {
-    /* Try with HTTP */
-    if (melo_http_client_status_ssl_failed (code)) {
-      player->updating = false;
-      player->use_https = false;
-      melo_webplayer_player_update_grabber (player);
+  gssize size;
+
+  /* Download finished */
+  size = g_output_stream_splice_finish (stream, res, &error);
+  g_object_unref (stream);
+  if (size < 0) {
+    /* Player has been released */
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free (error);
       return;
     }
 
     /* Abort update */
-    MELO_LOGE ("failed to download latest version");
-    g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
-    player->updating = false;
+    MELO_LOGE ("failed to save file: %s", error->message);
+    melo_webplayer_player_update_done (player, false);
+    g_error_free (error);
     return;
   }
 
+  MELO_LOGD ("%zd bytes downloaded", size);
+
   /* Generate grabber file path */
   file = g_build_filename (player->path, MELO_WEBPLAYER_PLAYER_GRABBER, NULL);
   output =
       g_build_filename (player->path, MELO_WEBPLAYER_PLAYER_GRABBER_PATH, NULL);
 
-  /* Remove script header */
-  if (data && size > 0 && data[0] == '#') {
-    const char *p;
+  /* Extract in background, the script header is skipped by the extractor */
+  melo_webplayer_unzip_extract_async (
+      file, output, player->cancellable, unzip_cb, player);
+
+  /* Release strings */
+  g_free (output);
+  g_free (file);
+}
+
+static void
+update_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+  GFileOutputStream *output;
+  GInputStream *stream;
+  GError *error = NULL;
+  unsigned int code;
+  GFile *file;
+  char *path;
+
+  /* Get response body as a stream */
+  stream = soup_session_send_finish (SOUP_SESSION (source_object), res, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* Player has been released */
+    g_error_free (error);
+    return;
+  }
+
+  /* Release request */
+  code = player->msg->status_code;
+  if (code != SOUP_STATUS_OK)
+    melo_webplayer_player_rate_limit (player, player->msg);
+  g_clear_object (&player->msg);
 
-    /* Find end of line */
-    p = memchr (data, '\n', size);
-    if (p) {
-      size -= p - data;
-      data = p + 1;
+  /* Failed to download update */
+  if (!stream || code != SOUP_STATUS_OK) {
+    /* Close stream */
+    if (stream)
+      g_object_unref (stream);
+
+    /* Try with HTTP */
+    if (melo_http_client_status_ssl_failed (code)) {
+      g_clear_error (&error);
+      player->updating = false;
+      player->use_https = false;
+      melo_webplayer_player_update_grabber (player);
+      return;
     }
+
+    /* Abort update */
+    MELO_LOGE ("failed to download latest version: %s",
+        error ? error->message : soup_status_get_phrase (code));
+    melo_webplayer_player_update_done (player, false);
+    g_clear_error (&error);
+    return;
   }
 
-  /* Save file */
-  if (!g_file_set_contents (file, data, size, &error)) {
+  /* Open grabber file: content is written to a temporary file first */
+  path = g_build_filename (player->path, MELO_WEBPLAYER_PLAYER_GRABBER, NULL);
+  file = g_file_new_for_path (path);
+  output = g_file_replace (
+      file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, NULL, &error);
+  g_object_unref (file);
+  g_free (path);
+  if (!output) {
     MELO_LOGE ("failed to save file: %s", error->message);
-    g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
-    player->updating = false;
+    melo_webplayer_player_update_done (player, false);
+    g_object_unref (stream);
     g_error_free (error);
-    goto end;
+    return;
   }
 
-  /* Unzip file */
-  player->process = g_subprocess_new (
-      G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_SILENCE,
-      &error, "unzip", "-od", output, file, NULL);
-  if (!player->process) {
-    MELO_LOGE ("failed to unzip: %s", error->message);
-    g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
-    player->updating = false;
-    g_error_free (error);
-  } else
-    g_subprocess_wait_async (player->process, NULL, unzip_cb, player);
+  /* Write body chunk by chunk as it is received */
+  g_output_stream_splice_async (G_OUTPUT_STREAM (output), stream,
+      G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+      G_PRIORITY_DEFAULT, player->cancellable, splice_cb, player);
+  g_object_unref (stream);
+}
 
-end:
-  /* Release strings */
-  g_free (output);
-  g_free (file);
+static void
+melo_webplayer_player_download (MeloWebplayerPlayer *player, const char *url)
+{
+  /* Send request: body is not buffered */
+  player->msg = soup_message_new ("GET", url);
+  if (!player->msg) {
+    MELO_LOGE ("invalid download URL: %s", url);
+    melo_webplayer_player_update_done (player, false);
+    return;
+  }
+  soup_session_send_async (
+      player->session, player->msg, player->cancellable, update_cb, player);
 }
 
 static void
-version_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
+melo_webplayer_player_check_version (
+    MeloWebplayerPlayer *player, JsonNode *node)
 {
-  MeloWebplayerPlayer *player = user_data;
   gchar *version = NULL;
   gsize len;
   JsonObject *obj;
@@ -389,9 +817,9 @@ version_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
   const gchar *url = NULL;
 
   /* Get JSON object */
-  obj = json_node_get_object (node);
-  if (!obj)
+  if (!node || !JSON_NODE_HOLDS_OBJECT (node))
     goto error;
+  obj = json_node_get_object (node);
 
   /* Get version string (tag_name) */
   vers = json_object_get_string_member (obj, "tag_name");
@@ -448,12 +876,9 @@ version_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
     MELO_LOGI ("use version: %s", url);
 
     /* Download new version */
-    melo_http_client_get (player->client, url, update_cb, player);
-  } else {
-    g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
-    player->last_update = g_get_monotonic_time ();
-    player->updating = false;
-  }
+    melo_webplayer_player_download (player, url);
+  } else
+    melo_webplayer_player_update_done (player, true);
 
   /* Free string */
   g_free (version);
@@ -475,8 +900,7 @@ error:
   if (g_file_test (file, G_FILE_TEST_EXISTS)) {
     /* Abort update */
     MELO_LOGE ("failed to get latest version");
-    g_async_queue_push (player->queue, melo_webplayer_player_empty_url);
-    player->updating = false;
+    melo_webplayer_player_update_done (player, false);
     g_free (file);
     return;
   }
@@ -486,23 +910,135 @@ error:
                           : "http://" MELO_WEBPLAYER_PLAYER_GRABBER_LATEST_URL;
 
   /* Download new version */
-  melo_http_client_get (player->client, url, update_cb, player);
+  melo_webplayer_player_download (player, url);
+}
+
+static void
+parse_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  JsonParser *parser = JSON_PARSER (source_object);
+  GError *error = NULL;
+
+  /* Release JSON parsed */
+  if (!json_parser_load_from_stream_finish (parser, res, &error)) {
+    /* Player has been released */
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_object_unref (parser);
+      g_error_free (error);
+      return;
+    }
+
+    MELO_LOGW ("failed to parse latest version: %s", error->message);
+    g_error_free (error);
+    melo_webplayer_player_check_version (user_data, NULL);
+  } else
+    melo_webplayer_player_check_version (
+        user_data, json_parser_get_root (parser));
+
+  g_object_unref (parser);
+}
+
+static void
+check_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+  GInputStream *stream;
+  GError *error = NULL;
+  SoupMessage *msg;
+  JsonParser *parser;
+
+  /* Get response body as a stream */
+  stream = soup_session_send_finish (SOUP_SESSION (source_object), res, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* Player has been released */
+    g_error_free (error);
+    return;
+  }
+
+  /* Take request */
+  msg = player->msg;
+  player->msg = NULL;
+
+  /* Release not modified since last check */
+  if (msg->status_code == SOUP_STATUS_NOT_MODIFIED) {
+    MELO_LOGD ("latest version not modified");
+    melo_webplayer_player_update_done (player, true);
+    goto end;
+  }
+
+  /* Failed to get latest version */
+  if (!stream || msg->status_code != SOUP_STATUS_OK) {
+    MELO_LOGW ("failed to check latest version: %s",
+        error ? error->message : soup_status_get_phrase (msg->status_code));
+
+    /* Retry when rate limit ends */
+    if (melo_webplayer_player_rate_limit (player, msg))
+      melo_webplayer_player_update_done (player, false);
+    else
+      melo_webplayer_player_check_version (player, NULL);
+    goto end;
+  }
+
+  /* Keep validators until release is installed */
+  player->new_etag =
+      g_strdup (soup_message_headers_get_one (msg->response_headers, "ETag"));
+  player->new_modified = g_strdup (
+      soup_message_headers_get_one (msg->response_headers, "Last-Modified"));
+
+  /* Parse release JSON from stream */
+  parser = json_parser_new ();
+  json_parser_load_from_stream_async (
+      parser, stream, player->cancellable, parse_cb, player);
+
+end:
+  /* Release request */
+  if (stream)
+    g_object_unref (stream);
+  g_object_unref (msg);
+  g_clear_error (&error);
 }
 
 static void
 melo_webplayer_player_update_grabber (MeloWebplayerPlayer *player)
 {
-  if (!player || !player->client || player->updating)
+  if (!player || player->updating)
     return;
 
   /* Start update */
   player->updating = true;
+  if (player->update_id) {
+    g_source_remove (player->update_id);
+    player->update_id = 0;
+  }
 
-  /* Download version JSON */
-  melo_http_client_get_json (player->client,
+  /* Get latest release, unless it has not changed since last check */
+  player->msg = soup_message_new ("GET",
       player->use_https ? "https://" MELO_WEBPLAYER_PLAYER_GRABBER_VERSION_URL
-                        : "http://" MELO_WEBPLAYER_PLAYER_GRABBER_VERSION_URL,
-      version_cb, player);
+                        : "http://" MELO_WEBPLAYER_PLAYER_GRABBER_VERSION_URL);
+  soup_message_headers_replace (player->msg->request_headers, "Accept",
+      "application/vnd.github+json");
+  if (player->installed && player->etag)
+    soup_message_headers_replace (
+        player->msg->request_headers, "If-None-Match", player->etag);
+  if (player->installed && player->modified)
+    soup_message_headers_replace (player->msg->request_headers,
+        "If-Modified-Since", player->modified);
+  soup_session_send_async (
+      player->session, player->msg, player->cancellable, check_cb, player);
+}
+
+static void
+melo_webplayer_player_update_duration (MeloWebplayerPlayer *player)
+{
+  gint64 position = 0, duration = 0;
+
+  /* Get position and duration */
+  gst_element_query_position (player->pipeline, GST_FORMAT_TIME, &position);
+  gst_element_query_duration (player->src, GST_FORMAT_TIME, &duration);
+
+  /* Update player */
+  melo_player_update_duration (
+      MELO_PLAYER (player), position / 1000000, duration / 1000000);
 }
 
 static gboolean
@@ -513,19 +1049,30 @@ bus_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
 
   /* Process bus message */
   switch (GST_MESSAGE_TYPE (msg)) {
-  case GST_MESSAGE_DURATION_CHANGED:
-  case GST_MESSAGE_ASYNC_DONE: {
-    gint64 position = 0, duration = 0;
-
-    /* Get position and duration */
-    gst_element_query_position (wplayer->pipeline, GST_FORMAT_TIME, &position);
-    gst_element_query_duration (wplayer->src, GST_FORMAT_TIME, &duration);
+  case GST_MESSAGE_ASYNC_DONE:
+    /* Pipeline pre-rolled */
+    if (wplayer->preroll_start) {
+      melo_webplayer_stats_add (
+          MELO_WEBPLAYER_STATS_PHASE_PREROLL, wplayer->preroll_start);
+      wplayer->preroll_start = 0;
+    }
 
-    /* Update player */
-    melo_player_update_duration (
-        player, position / 1000000, duration / 1000000);
+    /* Resume recovered stream at last position */
+    if (wplayer->resume_position >= 0) {
+      MELO_LOGI ("stream of %s recovered after %u attempt(s) in "
+                 "%" G_GINT64_FORMAT " ms",
+          wplayer->media_id, wplayer->recover_count,
+          (g_get_monotonic_time () - wplayer->recover_start) / 1000);
+      gst_element_seek_simple (wplayer->pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH, wplayer->resume_position);
+      gst_element_set_state (wplayer->pipeline, GST_STATE_PLAYING);
+      wplayer->resume_position = -1;
+    }
+    melo_webplayer_player_update_duration (wplayer);
+    break;
+  case GST_MESSAGE_DURATION_CHANGED:
+    melo_webplayer_player_update_duration (wplayer);
     break;
-  }
   case GST_MESSAGE_TAG: {
     GstTagList *tag_list;
     MeloTags *tags;
@@ -541,11 +1088,30 @@ bus_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
     gst_tag_list_unref (tag_list);
     break;
   }
-  case GST_MESSAGE_STREAM_START:
+  case GST_MESSAGE_STREAM_START: {
+    bool next = false;
+
+    /* Pre-rolled stream has replaced current one */
+    g_mutex_lock (&wplayer->mutex);
+    if (wplayer->next_url) {
+      g_free (wplayer->gapless_url);
+      wplayer->gapless_url = wplayer->next_url;
+      wplayer->next_url = NULL;
+      next = true;
+    }
+    g_mutex_unlock (&wplayer->mutex);
+
     /* Playback is started */
     melo_player_update_status (
         player, MELO_PLAYER_STATE_PLAYING, MELO_PLAYER_STREAM_STATE_NONE, 0);
+
+    /* Move playlist to next media, which is already playing */
+    if (next) {
+      MELO_LOGD ("gapless transition to next media");
+      melo_player_eos (player);
+    }
     break;
+  }
   case GST_MESSAGE_BUFFERING: {
     MeloPlayerStreamState state = MELO_PLAYER_STREAM_STATE_NONE;
     gint percent;
@@ -564,21 +1130,41 @@ bus_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
   case GST_MESSAGE_ERROR: {
     GError *error;
 
+    /* Get error */
+    gst_message_parse_error (msg, &error, NULL);
+
+    /* Network error: try to resume with a new stream */
+    if (error->domain == GST_RESOURCE_ERROR &&
+        melo_webplayer_player_recover (wplayer, error->message)) {
+      g_error_free (error);
+      break;
+    }
+
     /* Stop pipeline on error */
     gst_element_set_state (wplayer->pipeline, GST_STATE_NULL);
     melo_player_update_state (player, MELO_PLAYER_STATE_STOPPED);
 
     /* Set error message */
-    gst_message_parse_error (msg, &error, NULL);
     melo_player_error (player, error->message);
     g_error_free (error);
     break;
   }
-  case GST_MESSAGE_EOS:
+  case GST_MESSAGE_EOS: {
+    gint64 position = 0, duration = 0;
+
+    /* Connection closed before end of stream */
+    if (gst_element_query_position (
+            wplayer->pipeline, GST_FORMAT_TIME, &position) &&
+        gst_element_query_duration (wplayer->src, GST_FORMAT_TIME, &duration) &&
+        duration - position > MELO_WEBPLAYER_PLAYER_EOS_MARGIN * GST_SECOND &&
+        melo_webplayer_player_recover (wplayer, "premature end of stream"))
+      break;
+
     /* Stop playing */
     gst_element_set_state (wplayer->pipeline, GST_STATE_NULL);
     melo_player_eos (player);
     break;
+  }
   default:
     break;
   }
@@ -617,259 +1203,687 @@ pad_added_cb (GstElement *src, GstPad *pad, GstElement *sink)
   g_object_unref (sink_pad);
 }
 
-static gpointer
-melo_webplayer_player_thread_func (gpointer user_data)
+static char *
+melo_webplayer_player_get_local_uri (
+    MeloWebplayerPlayer *player, const char *id)
+{
+  char *path, *uri;
+
+  /* Find stream in audio cache */
+  path = melo_webplayer_audio_cache_lookup (player->audio_cache, id);
+  if (!path)
+    return NULL;
+
+  /* Convert to URI */
+  uri = g_filename_to_uri (path, NULL, NULL);
+  g_free (path);
+
+  return uri;
+}
+
+static void
+melo_webplayer_player_record (
+    MeloWebplayerPlayer *player, const MeloWebplayerStream *stream)
+{
+  if (!player->audio_cache)
+    return;
+
+  /* Record stream when its source is created */
+  g_mutex_lock (&player->mutex);
+  g_hash_table_replace (
+      player->recordings, g_strdup (stream->url), g_strdup (stream->id));
+  g_mutex_unlock (&player->mutex);
+}
+
+static GstPadProbeReturn
+record_probe_cb (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  MeloWebplayerAudioCacheWriter *writer = user_data;
+
+  /* Save stream data */
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstMapInfo map;
+    bool ret;
+
+    if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+      return GST_PAD_PROBE_OK;
+    ret = melo_webplayer_audio_cache_writer_write (writer,
+        GST_BUFFER_OFFSET_IS_VALID (buffer) ? GST_BUFFER_OFFSET (buffer)
+                                            : (guint64) -1,
+        map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+
+    return ret ? GST_PAD_PROBE_OK : GST_PAD_PROBE_REMOVE;
+  } else if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+      const GstSegment *segment;
+
+      /* Stream restarted at another position after a seek */
+      gst_event_parse_segment (event, &segment);
+      if (segment->format == GST_FORMAT_BYTES && segment->start &&
+          !melo_webplayer_audio_cache_writer_write (
+              writer, segment->start, NULL, 0))
+        return GST_PAD_PROBE_REMOVE;
+    } else if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+      gint64 size = -1;
+
+      /* Whole stream has been downloaded */
+      gst_pad_query_duration (pad, GST_FORMAT_BYTES, &size);
+      melo_webplayer_audio_cache_writer_finish (writer, size);
+      return GST_PAD_PROBE_REMOVE;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+source_setup_cb (GstElement *src, GstElement *source, gpointer user_data)
 {
   MeloWebplayerPlayer *player = user_data;
-  PyObject *module = NULL;
-  PyObject *instance = NULL;
-
-  while (!player->stop) {
-    PyObject *result;
-    const char *uri = NULL;
-    char *url, *p;
-
-    /* Wait next URL */
-    url = g_async_queue_pop (player->queue);
-    while ((p = g_async_queue_try_pop (player->queue)) != NULL) {
-      g_free (url);
-      url = p;
+  MeloWebplayerAudioCacheWriter *writer = NULL;
+  char *location = NULL;
+  GstPad *pad;
+
+  /* Only network sources are recorded */
+  if (!player->audio_cache ||
+      !g_object_class_find_property (G_OBJECT_GET_CLASS (source), "location"))
+    return;
+  g_object_get (source, "location", &location, NULL);
+  if (!location)
+    return;
+
+  /* Create writer */
+  g_mutex_lock (&player->mutex);
+  writer = melo_webplayer_audio_cache_writer_new (player->audio_cache,
+      g_hash_table_lookup (player->recordings, location));
+  g_hash_table_remove (player->recordings, location);
+  g_mutex_unlock (&player->mutex);
+  g_free (location);
+
+  if (!writer)
+    return;
+
+  /* Tee compressed stream data to audio cache */
+  pad = gst_element_get_static_pad (source, "src");
+  if (pad) {
+    gst_pad_add_probe (pad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        record_probe_cb, writer,
+        (GDestroyNotify) melo_webplayer_audio_cache_writer_free);
+    gst_object_unref (pad);
+  } else
+    melo_webplayer_audio_cache_writer_free (writer);
+}
+
+static GstPadProbeReturn
+first_audio_probe_cb (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+
+  /* First buffer since play() */
+  if (g_atomic_int_compare_and_exchange (&player->first_audio, 1, 0))
+    melo_webplayer_stats_add (
+        MELO_WEBPLAYER_STATS_PHASE_FIRST_AUDIO, player->play_start);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+melo_webplayer_player_start (MeloWebplayerPlayer *player, const char *uri)
+{
+  /* Set new webplayer URI */
+  g_object_set (player->src, "uri", uri, NULL);
+
+  /* Start measures, unless a stream is recovered */
+  player->preroll_start = g_get_monotonic_time ();
+  if (player->resume_position < 0)
+    g_atomic_int_set (&player->first_audio, 1);
+
+  /* Start playing, or wait for pre-roll to seek to last position */
+  gst_element_set_state (player->pipeline, player->resume_position >= 0
+                                               ? GST_STATE_PAUSED
+                                               : GST_STATE_PLAYING);
+}
+
+static gint
+select_stream_cb (GstElement *src, GstStreamCollection *collection,
+    GstStream *stream, gpointer user_data)
+{
+  /* Only select audio stream */
+  return gst_stream_get_stream_type (stream) & GST_STREAM_TYPE_AUDIO ? -1 : 0;
+}
+
+static void
+about_to_finish_cb (GstElement *src, gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+  MeloWebplayerPlayerPrefetch *prefetch;
+  MeloWebplayerStream *stream;
+  char *url = NULL, *uri = NULL, *id;
+
+  /* Get next playlist entry: the playlist is not visible from the player, so
+   * only an entry added just after the current media is known to follow it.
+   * Otherwise, next media is played after end of stream.
+   */
+  g_mutex_lock (&player->mutex);
+  prefetch = g_queue_peek_head (&player->prefetch);
+  if (prefetch && prefetch->prev && player->media_url &&
+      !strcmp (prefetch->prev, player->media_url))
+    url = g_strdup (prefetch->url);
+  g_mutex_unlock (&player->mutex);
+
+  if (!url) {
+    MELO_LOGD ("next media unknown: no gapless transition");
+    return;
+  }
+
+  /* Next stream must be in audio cache or already resolved */
+  id = melo_webplayer_stream_cache_get_id (url);
+  uri = melo_webplayer_player_get_local_uri (player, id);
+  if (!uri) {
+    stream = melo_webplayer_stream_cache_lookup (player->cache, id);
+    if (stream) {
+      melo_webplayer_player_record (player, stream);
+      uri = g_strdup (stream->url);
+      melo_webplayer_stream_free (stream);
     }
-    if (url == melo_webplayer_player_empty_url)
-      url = NULL;
+  }
+  g_free (id);
+  if (!uri) {
+    MELO_LOGD ("next stream not resolved: no gapless transition");
+    g_free (url);
+    return;
+  }
+
+  /* Chain next stream to current one */
+  g_object_set (src, "next-uri", uri, NULL);
+  g_free (uri);
+
+  /* Save next URL */
+  g_mutex_lock (&player->mutex);
+  g_free (player->next_url);
+  player->next_url = url;
+  g_mutex_unlock (&player->mutex);
+}
+
+static gboolean
+stall_cb (gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+  GstState state, pending;
+  gint64 position = -1;
+
+  /* Only a playing stream can stall */
+  if (gst_element_get_state (player->pipeline, &state, &pending, 0) ==
+          GST_STATE_CHANGE_FAILURE ||
+      state != GST_STATE_PLAYING || pending != GST_STATE_VOID_PENDING) {
+    player->stall_count = 0;
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Check position moves forward */
+  gst_element_query_position (player->pipeline, GST_FORMAT_TIME, &position);
+  if (position != player->stall_position) {
+    player->stall_position = position;
+    player->stall_count = 0;
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Stream is stalled */
+  if (++player->stall_count < MELO_WEBPLAYER_PLAYER_STALL_TIMEOUT)
+    return G_SOURCE_CONTINUE;
+  player->stall_id = 0;
+  melo_webplayer_player_recover (player, "stream stalled");
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_webplayer_player_play_stream (
+    MeloWebplayerPlayer *player, const MeloWebplayerStream *stream)
+{
+  char *uri;
+
+  /* Audio stream not found */
+  if (!stream) {
+    melo_player_update_state (MELO_PLAYER (player), MELO_PLAYER_STATE_STOPPED);
+    melo_player_error (MELO_PLAYER (player), "video not found");
+    return;
+  }
+
+  /* Play from audio cache or record stream */
+  uri = melo_webplayer_player_get_local_uri (player, stream->id);
+  player->local = uri != NULL;
+  if (!uri) {
+    melo_webplayer_player_record (player, stream);
+    uri = g_strdup (stream->url);
+
+    /* Detect stalled network stream */
+    if (!player->stall_id)
+      player->stall_id = g_timeout_add_seconds (1, stall_cb, player);
+    player->stall_position = -1;
+    player->stall_count = 0;
+  }
+
+  /* Start playing */
+  melo_webplayer_player_start (player, uri);
+  g_free (uri);
+}
+
+static void
+melo_webplayer_player_prefetch_free (gpointer data)
+{
+  MeloWebplayerPlayerPrefetch *prefetch = data;
+
+  g_free (prefetch->prev);
+  g_free (prefetch->url);
+  g_slice_free (MeloWebplayerPlayerPrefetch, prefetch);
+}
+
+static void
+melo_webplayer_player_job_free (gpointer data)
+{
+  MeloWebplayerPlayerJob *job = data;
+
+  melo_webplayer_stream_free (job->stream);
+  g_free (job->url);
+  g_slice_free (MeloWebplayerPlayerJob, job);
+}
+
+static gboolean
+result_idle_cb (gpointer user_data)
+{
+  MeloWebplayerPlayerJob *job = user_data;
+  MeloWebplayerPlayer *player = job->player;
+  GSource *source;
+  bool current;
+
+  g_mutex_lock (&player->mutex);
+
+  /* Result is not pending anymore */
+  source = g_main_current_source ();
+  if (source && g_source_get_id (source) == player->result_id)
+    player->result_id = 0;
 
-    /* Stop thread */
-    if (player->stop) {
-      g_free (url);
+  /* Check result is still expected */
+  current = job->serial == player->serial;
+
+  g_mutex_unlock (&player->mutex);
+
+  /* Play resolved stream */
+  if (current) {
+    if (player->deadline_id) {
+      g_source_remove (player->deadline_id);
+      player->deadline_id = 0;
+    }
+    player->job_id = 0;
+    melo_webplayer_player_play_stream (player, job->stream);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_webplayer_player_retry_prefetch (
+    MeloWebplayerPlayer *player, const char *url)
+{
+  GList *l;
+
+  g_mutex_lock (&player->mutex);
+
+  /* Resolve entry again on next scheduling */
+  for (l = player->prefetch.head; l != NULL; l = l->next) {
+    MeloWebplayerPlayerPrefetch *prefetch = l->data;
+
+    if (!strcmp (prefetch->url, url)) {
+      prefetch->done = false;
       break;
     }
+  }
 
-    /* Import module */
-    if (!module) {
-      PyObject *name;
-
-      /* Python not yet initialized */
-      if (!Py_IsInitialized ()) {
-        PyObject *frozen;
-        wchar_t *path;
-        size_t len;
-
-        /* Generate Python configuration */
-        PyConfig config;
-        PyConfig_InitPythonConfig (&config);
-        PyConfig_Read (&config);
-
-        /* Generate python path */
-        len = strlen (player->path) +
-              sizeof (MELO_WEBPLAYER_PLAYER_GRABBER_PATH) + 3;
-        path = malloc (len * sizeof (*path));
-        swprintf (path, len, L"%s/%s", player->path,
-            MELO_WEBPLAYER_PLAYER_GRABBER_PATH);
-
-        /* Set module search path */
-        config.module_search_paths_set = 1;
-        PyWideStringList_Append (&config.module_search_paths, path);
-        free (path);
-
-        /* Initialize python */
-        Py_InitializeFromConfig (&config);
-        PyConfig_Clear (&config);
-
-        /* HACK: prevent internal updater by setting sys.frozen */
-        frozen = PyUnicode_FromString ("melo");
-        PySys_SetObject ("frozen", frozen);
-        Py_DECREF (frozen);
-      }
+  g_mutex_unlock (&player->mutex);
+}
 
-      /* Create module name */
-      name = PyUnicode_FromString (MELO_WEBPLAYER_PLAYER_GRABBER_MODULE);
+static void
+resolve_cb (MeloWebplayerStream *stream, void *user_data)
+{
+  MeloWebplayerPlayerJob *job = user_data;
+  MeloWebplayerPlayer *player = job->player;
+
+  /* Save resolved stream */
+  if (stream)
+    melo_webplayer_stream_cache_add (player->cache, stream);
+  job->stream = stream;
+
+  /* Stream resolved in background */
+  if (job->prefetch) {
+    if (stream)
+      MELO_LOGD ("%s prefetched", stream->id);
+    else
+      melo_webplayer_player_retry_prefetch (player, job->url);
+    melo_webplayer_player_job_free (job);
+    return;
+  }
 
-      /* Import module */
-      module = PyImport_Import (name);
-      if (!module) {
-        MELO_LOGE ("failed to import module");
-        g_free (url);
+  g_mutex_lock (&player->mutex);
 
-        /* Print Python backtrace */
-        PyErr_Print ();
+  /* Play stream from main loop if still expected */
+  if (!player->stop && job->serial == player->serial) {
+    if (player->result_id)
+      g_source_remove (player->result_id);
+    player->result_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+        result_idle_cb, job, melo_webplayer_player_job_free);
+    job = NULL;
+  }
 
-        continue;
-      }
-      Py_DECREF (name);
+  g_mutex_unlock (&player->mutex);
 
-      MELO_LOGD ("module imported");
-    }
+  /* Drop result */
+  if (job)
+    melo_webplayer_player_job_free (job);
+}
+
+static unsigned int
+melo_webplayer_player_resolve (MeloWebplayerPlayer *player, const char *url,
+    const char *id, unsigned int serial, MeloWebplayerGrabberPriority priority)
+{
+  MeloWebplayerPlayerJob *job;
+
+  /* Create job */
+  job = g_slice_new0 (MeloWebplayerPlayerJob);
+  job->player = player;
+  job->serial = serial;
+  job->prefetch = priority != MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY;
+  if (job->prefetch)
+    job->url = g_strdup (url);
+
+  /* Resolve stream */
+  return melo_webplayer_grabber_resolve (
+      player->grabber, url, id, priority, resolve_cb, job);
+}
 
-    /* Instantiate object */
-    if (!instance) {
-      PyObject *dict, *class, *args;
+static void
+melo_webplayer_player_cancel (MeloWebplayerPlayer *player)
+{
+  /* Drop results of previous requests */
+  g_mutex_lock (&player->mutex);
+  player->serial++;
+  g_mutex_unlock (&player->mutex);
+
+  /* Abort pending request */
+  if (player->job_id) {
+    melo_webplayer_grabber_cancel (player->grabber, player->job_id);
+    player->job_id = 0;
+  }
+  if (player->deadline_id) {
+    g_source_remove (player->deadline_id);
+    player->deadline_id = 0;
+  }
+}
 
-      /* Get module dictionary */
-      dict = PyModule_GetDict (module);
-      if (!dict) {
-        MELO_LOGE ("failed to get module dictionary");
-        g_free (url);
-        continue;
-      }
+static gboolean
+deadline_cb (gpointer user_data)
+{
+  MeloWebplayerPlayer *player = user_data;
+  MeloWebplayerStream *stream;
 
-      /* Get class from module */
-      class = PyDict_GetItemString (dict, MELO_WEBPLAYER_PLAYER_GRABBER_CLASS);
-      if (!class) {
-        MELO_LOGE ("failed to get class");
-        g_free (url);
-        continue;
-      }
+  /* Abort request */
+  player->deadline_id = 0;
+  melo_webplayer_player_cancel (player);
 
-      /* Prepare instance arguments
-       *  - quiet=True (prevent that method call fails when running as daemon)
-       */
-      args = Py_BuildValue ("({s:i})", "quiet", Py_False);
-      if (!args) {
-        MELO_LOGE ("failed to create instance args");
-        g_free (url);
-        continue;
-      }
+  MELO_LOGW ("failed to resolve %s in time", player->job_stream_id);
 
-      /* Create object instance */
-      instance = PyObject_CallObject (class, args);
-      Py_DECREF (args);
-      if (!instance) {
-        MELO_LOGE ("failed to instantiate object");
-        g_free (url);
-        continue;
-      }
-      MELO_LOGD ("object instantiated");
+  /* Fallback on expired stream, which may still be accepted */
+  stream = melo_webplayer_stream_cache_lookup_stale (
+      player->cache, player->job_stream_id);
+  if (stream)
+    MELO_LOGI ("use expired stream for %s", stream->id);
+  melo_webplayer_player_play_stream (player, stream);
+  melo_webplayer_stream_free (stream);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_webplayer_player_schedule_prefetch (MeloWebplayerPlayer *player)
+{
+  GList *urls = NULL, *l;
+  bool next = false;
+  unsigned int i;
+
+  /* Grabber is being installed */
+  if (player->updating && !player->installed)
+    return;
+
+  g_mutex_lock (&player->mutex);
+
+  /* Find next entries to resolve */
+  for (l = player->prefetch.head, i = 0;
+       l != NULL && i < MELO_WEBPLAYER_PLAYER_PREFETCH_COUNT;
+       l = l->next, i++) {
+    MeloWebplayerPlayerPrefetch *prefetch = l->data;
+
+    if (!prefetch->done) {
+      prefetch->done = true;
+      urls = g_list_prepend (urls, g_strdup (prefetch->url));
+      next |= !i;
     }
+  }
 
-    /* No video to get */
-    if (!url)
-      continue;
-
-    /* Get video info */
-    result = PyObject_CallMethod (instance, "extract_info", "(sb)", url, 0);
-    if (result) {
-      PyObject *formats;
-
-      /* Get formats */
-      formats = PyDict_GetItemString (result, "formats");
-      if (PyList_Check (formats)) {
-        const char *v_uri = NULL, *a_uri = NULL;
-        double v_abr = 0, a_abr = 0;
-        unsigned int i, count;
-
-        /* Get formats count */
-        count = PyList_Size (formats);
-
-        /* Parse formats list */
-        for (i = 0; i < count; i++) {
-          PyObject *fmt, *tmp;
-          double br;
-
-          /* Get next format */
-          fmt = PyList_GetItem (formats, i);
-          if (!fmt)
-            continue;
-
-          /* Get audio codec */
-          tmp = PyDict_GetItemString (fmt, "acodec");
-          if (!tmp || !strcmp (PyUnicode_AsUTF8 (tmp), "none"))
-            continue;
-
-          /* Get audio bitrate */
-          tmp = PyDict_GetItemString (fmt, "abr");
-          if (!tmp) {
-            tmp = PyDict_GetItemString (fmt, "tbr");
-            if (!tmp)
-              continue;
-          }
-          if (Py_IS_TYPE (tmp, &PyFloat_Type))
-            br = PyFloat_AsDouble (tmp);
-          else if (Py_IS_TYPE (tmp, &PyLong_Type))
-            br = PyLong_AsDouble (tmp);
-          else {
-            br = 0;
-            MELO_LOGW ("unsupported bit-rate type");
-          }
-
-          /* Get URL */
-          tmp = PyDict_GetItemString (fmt, "url");
-          if (!tmp)
-            continue;
-          uri = PyUnicode_AsUTF8 (tmp);
-
-          /* Get video codec */
-          tmp = PyDict_GetItemString (fmt, "vcodec");
-          if (tmp && strcmp (PyUnicode_AsUTF8 (tmp), "none")) {
-            if (br > v_abr) {
-              v_abr = br;
-              v_uri = uri;
-            }
-          } else {
-            if (br > a_abr) {
-              a_abr = br;
-              a_uri = uri;
-            }
-          }
-        }
-
-        /* Select best URL (first audio track only, then video tack) */
-        if (a_uri)
-          uri = a_uri;
-        else if (v_uri)
-          uri = v_uri;
-        else
-          uri = NULL;
-        MELO_LOGD ("best audio track found: %f %f", a_abr, v_abr);
-      } else
-        MELO_LOGE ("failed to list formats");
-    } else
-      MELO_LOGE ("failed to extract video info");
-
-    /* Audio stream found */
-    if (uri) {
-      /* Set new webplayer URI */
-      g_object_set (player->src, "uri", uri, NULL);
-
-      /* Start playing */
-      gst_element_set_state (player->pipeline, GST_STATE_PLAYING);
-    } else {
-      melo_player_update_state (
-          MELO_PLAYER (player), MELO_PLAYER_STATE_STOPPED);
-      melo_player_error (MELO_PLAYER (player), "video not found");
+  g_mutex_unlock (&player->mutex);
+
+  /* Resolve entries not yet in cache: first entry is the next to play */
+  urls = g_list_reverse (urls);
+  for (l = urls; l != NULL; l = l->next) {
+    MeloWebplayerStream *stream;
+    char *id;
+
+    id = melo_webplayer_stream_cache_get_id (l->data);
+    stream = melo_webplayer_stream_cache_lookup (player->cache, id);
+    if (!stream)
+      melo_webplayer_player_resolve (player, l->data, id, 0,
+          l == urls && next ? MELO_WEBPLAYER_GRABBER_PRIORITY_NEXT
+                            : MELO_WEBPLAYER_GRABBER_PRIORITY_PREFETCH);
+    melo_webplayer_stream_free (stream);
+    g_free (id);
+  }
+  g_list_free_full (urls, g_free);
+}
+
+static void
+melo_webplayer_player_skip_prefetch (
+    MeloWebplayerPlayer *player, const char *url)
+{
+  GList *l;
+
+  g_mutex_lock (&player->mutex);
+
+  /* Remove all entries up to the played URL */
+  for (l = player->prefetch.head; l != NULL; l = l->next) {
+    MeloWebplayerPlayerPrefetch *prefetch = l->data;
+
+    if (!strcmp (prefetch->url, url)) {
+      while (player->prefetch.head != l)
+        melo_webplayer_player_prefetch_free (
+            g_queue_pop_head (&player->prefetch));
+      melo_webplayer_player_prefetch_free (
+          g_queue_pop_head (&player->prefetch));
+      break;
     }
+  }
+
+  g_mutex_unlock (&player->mutex);
+}
+
+static void
+melo_webplayer_player_stop (MeloWebplayerPlayer *player)
+{
+  /* Stop pipeline */
+  gst_element_set_state (player->pipeline, GST_STATE_NULL);
+
+  /* Stop stall detection */
+  if (player->stall_id) {
+    g_source_remove (player->stall_id);
+    player->stall_id = 0;
+  }
+
+  /* Drop pre-rolled stream and pending recordings */
+  if (player->gapless)
+    g_object_set (player->src, "next-uri", NULL, NULL);
+  g_mutex_lock (&player->mutex);
+  g_free (player->next_url);
+  player->next_url = NULL;
+  g_hash_table_remove_all (player->recordings);
+  g_mutex_unlock (&player->mutex);
+}
+
+static void
+melo_webplayer_player_request (
+    MeloWebplayerPlayer *player, const char *url, const char *id)
+{
+  /* Resolve stream with a deadline */
+  player->job_id = melo_webplayer_player_resolve (
+      player, url, id, player->serial, MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY);
+  player->deadline_id = g_timeout_add_seconds (
+      MELO_WEBPLAYER_PLAYER_DEADLINE, deadline_cb, player);
+  g_free (player->job_stream_id);
+  player->job_stream_id = g_strdup (id);
+}
+
+static void
+melo_webplayer_player_set_media (
+    MeloWebplayerPlayer *player, const char *url, const char *id)
+{
+  /* Set current media: URL is read from streaming thread */
+  g_mutex_lock (&player->mutex);
+  g_free (player->media_url);
+  player->media_url = g_strdup (url);
+  g_mutex_unlock (&player->mutex);
+  g_free (player->media_id);
+  player->media_id = g_strdup (id);
+  player->local = false;
+
+  /* Reset recovery */
+  player->recover_count = 0;
+  player->resume_position = -1;
+}
+
+static bool
+melo_webplayer_player_recover (MeloWebplayerPlayer *player, const char *reason)
+{
+  gint64 position = 0;
+
+  /* Only network streams are recovered */
+  if (!player->media_id || player->local ||
+      player->recover_count >= MELO_WEBPLAYER_PLAYER_RECOVER_MAX)
+    return false;
 
-    /* Release result */
-    Py_XDECREF (result);
+  /* Save position, unless a recovery is still in progress */
+  if (player->resume_position < 0) {
+    gst_element_query_position (player->pipeline, GST_FORMAT_TIME, &position);
+    player->resume_position = position;
   }
+  if (!player->recover_count)
+    player->recover_start = g_get_monotonic_time ();
+  player->recover_count++;
 
-  /* Release python objects */
-  Py_XDECREF (instance);
-  Py_XDECREF (module);
+  MELO_LOGW ("stream of %s failed (%s): recovery attempt %u at "
+             "%" G_GINT64_FORMAT " s",
+      player->media_id, reason, player->recover_count,
+      player->resume_position / GST_SECOND);
 
-  /* Finalize python */
-  Py_Finalize ();
+  /* Stop pipeline and abort pending request */
+  melo_webplayer_player_cancel (player);
+  melo_webplayer_player_stop (player);
+  melo_player_update_stream_state (
+      MELO_PLAYER (player), MELO_PLAYER_STREAM_STATE_BUFFERING, 0);
 
-  return NULL;
+  /* Resolve stream again */
+  melo_webplayer_stream_cache_remove (player->cache, player->media_id);
+  melo_webplayer_player_request (player, player->media_url, player->media_id);
+
+  return true;
 }
 
 static bool
 melo_webplayer_player_play (MeloPlayer *player, const char *url)
 {
   MeloWebplayerPlayer *wplayer = MELO_WEBPLAYER_PLAYER (player);
+  MeloWebplayerStream *stream;
+  bool gapless;
+  char *id, *uri;
+
+  /* Start time to first audio measure */
+  wplayer->play_start = g_get_monotonic_time ();
+
+  /* Check if media is already playing after a gapless transition */
+  g_mutex_lock (&wplayer->mutex);
+  gapless = wplayer->gapless_url && !strcmp (wplayer->gapless_url, url);
+  g_free (wplayer->gapless_url);
+  wplayer->gapless_url = NULL;
+  g_mutex_unlock (&wplayer->mutex);
+
+  /* Abort previous request */
+  melo_webplayer_player_cancel (wplayer);
+
+  /* Set current media */
+  id = melo_webplayer_stream_cache_get_id (url);
+  melo_webplayer_player_set_media (wplayer, url, id);
+
+  /* Keep pipeline running */
+  if (gapless) {
+    uri = melo_webplayer_player_get_local_uri (wplayer, id);
+    wplayer->local = uri != NULL;
+    g_free (uri);
+    g_free (id);
+
+    melo_webplayer_player_skip_prefetch (wplayer, url);
+    melo_player_update_status (player, MELO_PLAYER_STATE_PLAYING,
+        MELO_PLAYER_STREAM_STATE_NONE, 0);
+    melo_webplayer_player_update_duration (wplayer);
+    melo_webplayer_player_schedule_prefetch (wplayer);
+    return true;
+  }
 
   /* Stop previously playing webplayer */
-  gst_element_set_state (wplayer->pipeline, GST_STATE_NULL);
+  melo_webplayer_player_stop (wplayer);
 
-  /* Update in progress */
-  if (wplayer->updating) {
+  /* Playlist moved forward */
+  melo_webplayer_player_skip_prefetch (wplayer, url);
+
+  /* No grabber installed yet: play when first install is done, otherwise the
+   * current version is used during update.
+   */
+  if (wplayer->updating && !wplayer->installed) {
     /* Save URL */
     g_free (wplayer->url);
     wplayer->url = g_strdup (url);
+    g_free (id);
     return true;
   }
 
-  /* Add URL to queue */
-  g_async_queue_push (wplayer->queue, g_strdup (url));
+  /* Find audio or resolved stream in cache */
+  uri = melo_webplayer_player_get_local_uri (wplayer, id);
+  if (uri) {
+    MELO_LOGD ("play %s from audio cache", id);
+    wplayer->local = true;
+    melo_webplayer_player_start (wplayer, uri);
+    g_free (uri);
+  } else if ((stream = melo_webplayer_stream_cache_lookup (
+                  wplayer->cache, id)) != NULL) {
+    MELO_LOGD ("use cached stream for %s", id);
+    melo_webplayer_player_play_stream (wplayer, stream);
+    melo_webplayer_stream_free (stream);
+  } else
+    melo_webplayer_player_request (wplayer, url, id);
+  g_free (id);
+
+  /* Resolve next playlist entries */
+  melo_webplayer_player_schedule_prefetch (wplayer);
 
   return true;
 }
@@ -883,8 +1897,11 @@ melo_webplayer_player_set_state (MeloPlayer *player, MeloPlayerState state)
     gst_element_set_state (wplayer->pipeline, GST_STATE_PLAYING);
   else if (state == MELO_PLAYER_STATE_PAUSED)
     gst_element_set_state (wplayer->pipeline, GST_STATE_PAUSED);
-  else
-    gst_element_set_state (wplayer->pipeline, GST_STATE_NULL);
+  else {
+    /* Abort pending request */
+    melo_webplayer_player_cancel (wplayer);
+    melo_webplayer_player_stop (wplayer);
+  }
 
   return true;
 }
@@ -913,3 +1930,31 @@ melo_webplayer_player_get_position (MeloPlayer *player)
 
   return value / 1000000;
 }
+
+void
+melo_webplayer_player_prefetch (MeloWebplayerPlayer *player, const char *url)
+{
+  MeloWebplayerPlayerPrefetch *prefetch, *tail;
+
+  if (!player || !url)
+    return;
+
+  g_mutex_lock (&player->mutex);
+
+  /* Drop oldest entries */
+  while (player->prefetch.length >= MELO_WEBPLAYER_PLAYER_PREFETCH_MAX)
+    melo_webplayer_player_prefetch_free (g_queue_pop_head (&player->prefetch));
+
+  /* Add entry to list: it follows previously added entry, or current media */
+  tail = g_queue_peek_tail (&player->prefetch);
+  prefetch = g_slice_new (MeloWebplayerPlayerPrefetch);
+  prefetch->url = g_strdup (url);
+  prefetch->prev = g_strdup (tail ? tail->url : player->media_url);
+  prefetch->done = false;
+  g_queue_push_tail (&player->prefetch, prefetch);
+
+  g_mutex_unlock (&player->mutex);
+
+  /* Resolve next playlist entries */
+  melo_webplayer_player_schedule_prefetch (player);
+}
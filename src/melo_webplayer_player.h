@@ -35,6 +35,24 @@ MELO_DECLARE_PLAYER (
  */
 MeloWebplayerPlayer *melo_webplayer_player_new (void);
 
+/**
+ * Resolve an upcoming playlist entry in background.
+ *
+ * The URL is resolved at low priority while the current media is playing, in
+ * order to start playback immediately when melo_webplayer_player_play() is
+ * called for it. Only the next few entries are resolved ahead.
+ *
+ * The playlist cannot be read by the player: only the entries given with this
+ * function are known, which are the media added from the YouTube browser.
+ * Entries added by other means (library, another client of the playlist) or
+ * reordered in the playlist are resolved when they are played.
+ *
+ * @param player the webplayer player
+ * @param url the URL of the media added to the playlist
+ */
+void melo_webplayer_player_prefetch (
+    MeloWebplayerPlayer *player, const char *url);
+
 G_END_DECLS
 
 #endif /* !_MELO_WEBPLAYER_PLAYER_H_ */
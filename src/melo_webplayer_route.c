@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <string.h>
+
+#include "melo_webplayer_route.h"
+
+/* Routing table: the first matching entry is used */
+static const MeloWebplayerRoute melo_webplayer_routes[] = {
+    {"www.youtube.com", "/watch", "Youtube"},
+    {"www.youtube.com", "/shorts/", "Youtube"},
+    {"m.youtube.com", "/watch", "Youtube"},
+    {"music.youtube.com", "/watch", "Youtube"},
+    {"youtube.com", "/watch", "Youtube"},
+    {"youtu.be", "/", "Youtube"},
+    {"www.dailymotion.com", "/video/", "Dailymotion"},
+    {NULL, NULL, NULL},
+};
+
+const char *
+melo_webplayer_route_find (const char *url)
+{
+  const MeloWebplayerRoute *route;
+  const char *host, *path;
+  size_t len;
+
+  if (!url)
+    return NULL;
+
+  /* Skip scheme */
+  if (!g_ascii_strncasecmp (url, "https://", 8))
+    host = url + 8;
+  else if (!g_ascii_strncasecmp (url, "http://", 7))
+    host = url + 7;
+  else
+    return NULL;
+
+  /* Find path: URLs with port or credentials are not routed */
+  len = strcspn (host, "/?#:@");
+  path = host + len;
+  if (*path != '/')
+    return NULL;
+
+  /* Find route */
+  for (route = melo_webplayer_routes; route->host; route++)
+    if (strlen (route->host) == len &&
+        !g_ascii_strncasecmp (host, route->host, len) &&
+        g_str_has_prefix (path, route->path))
+      return route->ie_key;
+
+  return NULL;
+}
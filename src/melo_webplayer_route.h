@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#ifndef _MELO_WEBPLAYER_ROUTE_H_
+#define _MELO_WEBPLAYER_ROUTE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * MeloWebplayerRoute:
+ * @host: the URL host, NULL for the table end
+ * @path: the URL path prefix
+ * @ie_key: the key of the grabber extractor handling the URL
+ *
+ * An entry of the table used to route an URL to a grabber extractor.
+ */
+typedef struct {
+  const char *host;
+  const char *path;
+  const char *ie_key;
+} MeloWebplayerRoute;
+
+/**
+ * Find the extractor handling an URL.
+ *
+ * Only URLs of known hosts are routed: for other URLs, the grabber must probe
+ * all its extractors.
+ *
+ * @param url the URL to route
+ * @return the extractor key, or NULL if the URL is unknown.
+ */
+const char *melo_webplayer_route_find (const char *url);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_ROUTE_H_ */
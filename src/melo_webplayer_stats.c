@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MELO_LOG_TAG "webplayer_stats"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_stats.h"
+
+/* Number of samples kept per phase */
+#define MELO_WEBPLAYER_STATS_SAMPLES 128
+/* Number of new samples between two reports of a phase */
+#define MELO_WEBPLAYER_STATS_REPORT 16
+
+typedef struct {
+  gint64 samples[MELO_WEBPLAYER_STATS_SAMPLES];
+  unsigned int count;
+  unsigned int index;
+} MeloWebplayerStatsSet;
+
+static const char *melo_webplayer_stats_names[] = {
+    [MELO_WEBPLAYER_STATS_PHASE_PY_INIT] = "py_init",
+    [MELO_WEBPLAYER_STATS_PHASE_IMPORT] = "import",
+    [MELO_WEBPLAYER_STATS_PHASE_INSTANTIATE] = "instantiate",
+    [MELO_WEBPLAYER_STATS_PHASE_EXTRACT] = "extract_info",
+    [MELO_WEBPLAYER_STATS_PHASE_SELECT] = "format_select",
+    [MELO_WEBPLAYER_STATS_PHASE_PREROLL] = "preroll",
+    [MELO_WEBPLAYER_STATS_PHASE_FIRST_AUDIO] = "first_audio",
+    [MELO_WEBPLAYER_STATS_PHASE_QUEUE_WAIT] = "queue_wait",
+    [MELO_WEBPLAYER_STATS_PHASE_API_REQUEST] = "api_request",
+    [MELO_WEBPLAYER_STATS_PHASE_API_PARSE] = "api_parse",
+};
+
+static GMutex melo_webplayer_stats_mutex;
+static MeloWebplayerStatsSet
+    melo_webplayer_stats_sets[MELO_WEBPLAYER_STATS_PHASE_COUNT];
+
+static int
+melo_webplayer_stats_cmp (const void *a, const void *b)
+{
+  gint64 va = *(const gint64 *) a, vb = *(const gint64 *) b;
+
+  return va < vb ? -1 : va > vb;
+}
+
+static void
+melo_webplayer_stats_report (MeloWebplayerStatsPhase phase)
+{
+  MeloWebplayerStatsSet *set = &melo_webplayer_stats_sets[phase];
+  gint64 samples[MELO_WEBPLAYER_STATS_SAMPLES];
+  unsigned int n;
+
+  /* Sort samples */
+  n = MIN (set->count, MELO_WEBPLAYER_STATS_SAMPLES);
+  if (!n)
+    return;
+  memcpy (samples, set->samples, n * sizeof (*samples));
+  qsort (samples, n, sizeof (*samples), melo_webplayer_stats_cmp);
+
+  /* Log percentiles */
+  MELO_LOGI ("%s: n=%u p50=%.1f p90=%.1f p99=%.1f max=%.1f ms",
+      melo_webplayer_stats_names[phase], set->count,
+      samples[n * 50 / 100] / 1000.0, samples[n * 90 / 100] / 1000.0,
+      samples[n * 99 / 100] / 1000.0, samples[n - 1] / 1000.0);
+}
+
+void
+melo_webplayer_stats_add (MeloWebplayerStatsPhase phase, gint64 start)
+{
+  gint64 duration = g_get_monotonic_time () - start;
+  MeloWebplayerStatsSet *set;
+
+  if (phase >= MELO_WEBPLAYER_STATS_PHASE_COUNT)
+    return;
+  set = &melo_webplayer_stats_sets[phase];
+
+  g_mutex_lock (&melo_webplayer_stats_mutex);
+
+  /* Add sample */
+  set->samples[set->index] = duration;
+  set->index = (set->index + 1) % MELO_WEBPLAYER_STATS_SAMPLES;
+  set->count++;
+
+  /* Report phase periodically, and on first sample */
+  MELO_LOGD ("%s: %.1f ms", melo_webplayer_stats_names[phase],
+      duration / 1000.0);
+  if (set->count == 1 || !(set->count % MELO_WEBPLAYER_STATS_REPORT))
+    melo_webplayer_stats_report (phase);
+
+  g_mutex_unlock (&melo_webplayer_stats_mutex);
+}
+
+void
+melo_webplayer_stats_dump (void)
+{
+  unsigned int i;
+
+  g_mutex_lock (&melo_webplayer_stats_mutex);
+  for (i = 0; i < MELO_WEBPLAYER_STATS_PHASE_COUNT; i++)
+    melo_webplayer_stats_report (i);
+  g_mutex_unlock (&melo_webplayer_stats_mutex);
+}
+
+const char *
+melo_webplayer_stats_get_name (MeloWebplayerStatsPhase phase)
+{
+  if (phase >= MELO_WEBPLAYER_STATS_PHASE_COUNT)
+    return NULL;
+
+  return melo_webplayer_stats_names[phase];
+}
+
+unsigned int
+melo_webplayer_stats_get_samples (
+    MeloWebplayerStatsPhase phase, gint64 *samples, unsigned int max)
+{
+  MeloWebplayerStatsSet *set;
+  unsigned int i, n, first;
+
+  if (phase >= MELO_WEBPLAYER_STATS_PHASE_COUNT || !samples)
+    return 0;
+  set = &melo_webplayer_stats_sets[phase];
+
+  g_mutex_lock (&melo_webplayer_stats_mutex);
+
+  /* Copy last samples, from the oldest one */
+  n = MIN (set->count, MELO_WEBPLAYER_STATS_SAMPLES);
+  first = (set->index + MELO_WEBPLAYER_STATS_SAMPLES - n) %
+          MELO_WEBPLAYER_STATS_SAMPLES;
+  if (n > max) {
+    first = (first + n - max) % MELO_WEBPLAYER_STATS_SAMPLES;
+    n = max;
+  }
+  for (i = 0; i < n; i++)
+    samples[i] = set->samples[(first + i) % MELO_WEBPLAYER_STATS_SAMPLES];
+
+  g_mutex_unlock (&melo_webplayer_stats_mutex);
+
+  return n;
+}
+
+void
+melo_webplayer_stats_reset (void)
+{
+  g_mutex_lock (&melo_webplayer_stats_mutex);
+  memset (melo_webplayer_stats_sets, 0, sizeof (melo_webplayer_stats_sets));
+  g_mutex_unlock (&melo_webplayer_stats_mutex);
+}
+
+unsigned int
+melo_webplayer_stats_get_rss (void)
+{
+  unsigned long size, rss = 0;
+  FILE *fp;
+
+  /* Get resident set size (in pages) */
+  fp = fopen ("/proc/self/statm", "r");
+  if (fp) {
+    if (fscanf (fp, "%lu %lu", &size, &rss) != 2)
+      rss = 0;
+    fclose (fp);
+  }
+
+  return rss * (sysconf (_SC_PAGESIZE) / 1024);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_STATS_H_
+#define _MELO_WEBPLAYER_STATS_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * MeloWebplayerStatsPhase:
+ * @MELO_WEBPLAYER_STATS_PHASE_PY_INIT: Python interpreter initialization
+ * @MELO_WEBPLAYER_STATS_PHASE_IMPORT: grabber module import
+ * @MELO_WEBPLAYER_STATS_PHASE_INSTANTIATE: grabber instantiation
+ * @MELO_WEBPLAYER_STATS_PHASE_EXTRACT: grabber extract_info() call
+ * @MELO_WEBPLAYER_STATS_PHASE_SELECT: audio format selection
+ * @MELO_WEBPLAYER_STATS_PHASE_PREROLL: pipeline pre-roll
+ * @MELO_WEBPLAYER_STATS_PHASE_FIRST_AUDIO: time from play() to first buffer
+ *     at sink
+ * @MELO_WEBPLAYER_STATS_PHASE_QUEUE_WAIT: time spent by a job in the grabber
+ *     queue
+ * @MELO_WEBPLAYER_STATS_PHASE_API_REQUEST: time to receive a YouTube Data API
+ *     response
+ * @MELO_WEBPLAYER_STATS_PHASE_API_PARSE: YouTube Data API response parsing
+ *
+ * A phase of the play path, or of the browser.
+ */
+typedef enum _MeloWebplayerStatsPhase {
+  MELO_WEBPLAYER_STATS_PHASE_PY_INIT = 0,
+  MELO_WEBPLAYER_STATS_PHASE_IMPORT,
+  MELO_WEBPLAYER_STATS_PHASE_INSTANTIATE,
+  MELO_WEBPLAYER_STATS_PHASE_EXTRACT,
+  MELO_WEBPLAYER_STATS_PHASE_SELECT,
+  MELO_WEBPLAYER_STATS_PHASE_PREROLL,
+  MELO_WEBPLAYER_STATS_PHASE_FIRST_AUDIO,
+  MELO_WEBPLAYER_STATS_PHASE_QUEUE_WAIT,
+  MELO_WEBPLAYER_STATS_PHASE_API_REQUEST,
+  MELO_WEBPLAYER_STATS_PHASE_API_PARSE,
+
+  MELO_WEBPLAYER_STATS_PHASE_COUNT,
+} MeloWebplayerStatsPhase;
+
+/**
+ * Add a duration sample to a phase.
+ *
+ * The last samples of each phase are kept and their percentiles are logged
+ * periodically. This function is thread-safe.
+ *
+ * @param phase the phase
+ * @param start the phase start time, from g_get_monotonic_time()
+ */
+void melo_webplayer_stats_add (MeloWebplayerStatsPhase phase, gint64 start);
+
+/**
+ * Log percentiles of all phases.
+ */
+void melo_webplayer_stats_dump (void);
+
+/**
+ * Get name of a phase.
+ *
+ * @param phase the phase
+ * @return the phase name, as used in logs, or NULL.
+ */
+const char *melo_webplayer_stats_get_name (MeloWebplayerStatsPhase phase);
+
+/**
+ * Get the last duration samples of a phase.
+ *
+ * Samples are copied in arrival order, from the oldest one.
+ *
+ * @param phase the phase
+ * @param samples the array to fill with durations (in us)
+ * @param max the size of @samples
+ * @return the number of samples copied.
+ */
+unsigned int melo_webplayer_stats_get_samples (
+    MeloWebplayerStatsPhase phase, gint64 *samples, unsigned int max);
+
+/**
+ * Drop samples of all phases.
+ */
+void melo_webplayer_stats_reset (void);
+
+/**
+ * Get the current resident set size of the process.
+ *
+ * Unlike the peak size, it can be compared before and after an operation.
+ *
+ * @return the resident set size (in KiB), or 0 if it is not available.
+ */
+unsigned int melo_webplayer_stats_get_rss (void);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_STATS_H_ */
@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MELO_LOG_TAG "webplayer_cache"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_stream_cache.h"
+
+/* Minimal remaining validity of a cached stream URL (in seconds) */
+#define MELO_WEBPLAYER_STREAM_CACHE_MARGIN 120
+/* Validity of a stream URL without expiration parameter (in seconds) */
+#define MELO_WEBPLAYER_STREAM_CACHE_TTL 3600
+/* Delay before the file is saved after a change (in seconds) */
+#define MELO_WEBPLAYER_STREAM_CACHE_SAVE_DELAY 5
+
+#define MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_PREFIX "youtube:"
+#define MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_ID_LEN 11
+
+struct _MeloWebplayerStreamCache {
+  GMutex mutex;
+
+  char *path;
+  unsigned int size;
+
+  GHashTable *table;
+  GQueue list;
+  guint save_id;
+};
+
+MeloWebplayerStream *
+melo_webplayer_stream_new (
+    const char *id, const char *url, const char *codec, double bitrate)
+{
+  MeloWebplayerStream *stream;
+  const char *p;
+
+  /* Allocate stream */
+  stream = g_slice_new0 (MeloWebplayerStream);
+  stream->id = g_strdup (id);
+  stream->url = g_strdup (url);
+  stream->codec = g_strdup (codec);
+  stream->bitrate = bitrate;
+
+  /* Find expiration time from URL (query or path parameter) */
+  p = strstr (url, "expire=");
+  if (p)
+    p += 7;
+  else if ((p = strstr (url, "/expire/")) != NULL)
+    p += 8;
+  if (p)
+    stream->expire = g_ascii_strtoll (p, NULL, 10);
+
+  /* Use default validity */
+  if (stream->expire <= 0)
+    stream->expire =
+        g_get_real_time () / G_USEC_PER_SEC + MELO_WEBPLAYER_STREAM_CACHE_TTL;
+
+  return stream;
+}
+
+MeloWebplayerStream *
+melo_webplayer_stream_copy (const MeloWebplayerStream *stream)
+{
+  MeloWebplayerStream *copy;
+
+  if (!stream)
+    return NULL;
+
+  /* Copy stream */
+  copy = g_slice_new (MeloWebplayerStream);
+  copy->id = g_strdup (stream->id);
+  copy->url = g_strdup (stream->url);
+  copy->codec = g_strdup (stream->codec);
+  copy->bitrate = stream->bitrate;
+  copy->expire = stream->expire;
+
+  return copy;
+}
+
+void
+melo_webplayer_stream_free (MeloWebplayerStream *stream)
+{
+  if (!stream)
+    return;
+
+  g_free (stream->id);
+  g_free (stream->url);
+  g_free (stream->codec);
+  g_slice_free (MeloWebplayerStream, stream);
+}
+
+static bool
+is_youtube_id (const char *id, size_t len)
+{
+  size_t i;
+
+  if (len != MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_ID_LEN)
+    return false;
+
+  for (i = 0; i < len; i++)
+    if (!g_ascii_isalnum (id[i]) && id[i] != '-' && id[i] != '_')
+      return false;
+
+  return true;
+}
+
+static bool
+is_host (const char *host, size_t len, const char *name)
+{
+  size_t name_len = strlen (name);
+
+  return len == name_len && !g_ascii_strncasecmp (host, name, len);
+}
+
+char *
+melo_webplayer_stream_cache_get_id (const char *url)
+{
+  const char *host, *path, *id = NULL, *p;
+  size_t len, id_len = 0;
+
+  if (!url || *url == '\0')
+    return NULL;
+
+  /* Skip scheme */
+  p = strstr (url, "://");
+  host = p ? p + 3 : url;
+
+  /* Get host and path */
+  len = strcspn (host, "/?#");
+  path = host + len;
+
+  /* Skip sub-domains */
+  if (len > 4 && !g_ascii_strncasecmp (host, "www.", 4)) {
+    host += 4;
+    len -= 4;
+  } else if (len > 2 && !g_ascii_strncasecmp (host, "m.", 2)) {
+    host += 2;
+    len -= 2;
+  } else if (len > 6 && !g_ascii_strncasecmp (host, "music.", 6)) {
+    host += 6;
+    len -= 6;
+  }
+
+  /* Find Youtube video ID */
+  if (is_host (host, len, "youtu.be")) {
+    /* Short link: youtu.be/ID */
+    if (*path == '/') {
+      id = path + 1;
+      id_len = strcspn (id, "/?#&");
+    }
+  } else if (is_host (host, len, "youtube.com") ||
+             is_host (host, len, "youtube-nocookie.com")) {
+    if (g_str_has_prefix (path, "/watch")) {
+      /* Watch page: find 'v' parameter in query */
+      p = strchr (path, '?');
+      while (p && *p != '#') {
+        p++;
+        if (g_str_has_prefix (p, "v=")) {
+          id = p + 2;
+          id_len = strcspn (id, "&#");
+          break;
+        }
+        p = strpbrk (p, "&#");
+      }
+    } else if (g_str_has_prefix (path, "/shorts/") ||
+               g_str_has_prefix (path, "/embed/") ||
+               g_str_has_prefix (path, "/live/") ||
+               g_str_has_prefix (path, "/v/")) {
+      /* Other pages: ID is the second path element */
+      id = strchr (path + 1, '/') + 1;
+      id_len = strcspn (id, "/?#&");
+    }
+  }
+
+  /* Generate canonical ID */
+  if (id && is_youtube_id (id, id_len)) {
+    char *ret;
+
+    ret = g_malloc (sizeof (MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_PREFIX) +
+                    id_len);
+    memcpy (ret, MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_PREFIX,
+        sizeof (MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_PREFIX) - 1);
+    memcpy (ret + sizeof (MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_PREFIX) - 1, id,
+        id_len);
+    ret[sizeof (MELO_WEBPLAYER_STREAM_CACHE_YOUTUBE_PREFIX) - 1 + id_len] =
+        '\0';
+
+    return ret;
+  }
+
+  /* Unknown host: use URL without fragment */
+  return g_strndup (url, strcspn (url, "# \t\n"));
+}
+
+static GString *
+melo_webplayer_stream_cache_dump (MeloWebplayerStreamCache *cache)
+{
+  GString *str;
+  GList *l;
+
+  /* Generate file content: one stream per line, most recent first */
+  str = g_string_new (NULL);
+  for (l = cache->list.head; l != NULL; l = l->next) {
+    MeloWebplayerStream *stream = l->data;
+    char bitrate[G_ASCII_DTOSTR_BUF_SIZE];
+
+    /* Bit-rate is written independently of locale */
+    g_ascii_formatd (bitrate, sizeof (bitrate), "%.3f", stream->bitrate);
+    g_string_append_printf (str, "%s %" G_GINT64_FORMAT " %s %s %s\n",
+        stream->id, stream->expire, bitrate,
+        stream->codec ? stream->codec : "-", stream->url);
+  }
+
+  return str;
+}
+
+static void
+melo_webplayer_stream_cache_save (MeloWebplayerStreamCache *cache, GString *str)
+{
+  GError *error = NULL;
+
+  /* Save file */
+  if (!g_file_set_contents (cache->path, str->str, str->len, &error)) {
+    MELO_LOGW ("failed to save stream cache: %s", error->message);
+    g_error_free (error);
+  }
+  g_string_free (str, TRUE);
+}
+
+static gboolean
+save_cb (gpointer user_data)
+{
+  MeloWebplayerStreamCache *cache = user_data;
+  GString *str;
+
+  /* Take a snapshot of entries */
+  g_mutex_lock (&cache->mutex);
+  cache->save_id = 0;
+  str = melo_webplayer_stream_cache_dump (cache);
+  g_mutex_unlock (&cache->mutex);
+
+  /* Write file without blocking lookups */
+  melo_webplayer_stream_cache_save (cache, str);
+
+  return FALSE;
+}
+
+static void
+melo_webplayer_stream_cache_schedule_save (MeloWebplayerStreamCache *cache)
+{
+  /* Batch changes: file is saved from main loop */
+  if (cache->path && !cache->save_id)
+    cache->save_id = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+        MELO_WEBPLAYER_STREAM_CACHE_SAVE_DELAY, save_cb, cache, NULL);
+}
+
+static void
+melo_webplayer_stream_cache_load (MeloWebplayerStreamCache *cache)
+{
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+  char *data, *line, *next;
+
+  /* Read file */
+  if (!cache->path || !g_file_get_contents (cache->path, &data, NULL, NULL))
+    return;
+
+  /* Parse lines */
+  for (line = data; line && *line != '\0'; line = next) {
+    MeloWebplayerStream *stream;
+    char **fields;
+
+    /* Split line */
+    next = strchr (line, '\n');
+    if (next)
+      *next++ = '\0';
+
+    /* Parse fields: ID, expiration, bit-rate, codec and URL */
+    fields = g_strsplit (line, " ", 5);
+    if (g_strv_length (fields) != 5 ||
+        g_hash_table_contains (cache->table, fields[0]) ||
+        cache->list.length >= cache->size) {
+      g_strfreev (fields);
+      continue;
+    }
+
+    /* Create stream */
+    stream = g_slice_new (MeloWebplayerStream);
+    stream->id = g_strdup (fields[0]);
+    stream->expire = g_ascii_strtoll (fields[1], NULL, 10);
+    stream->bitrate = g_ascii_strtod (fields[2], NULL);
+    stream->codec = strcmp (fields[3], "-") ? g_strdup (fields[3]) : NULL;
+    stream->url = g_strdup (fields[4]);
+    g_strfreev (fields);
+
+    /* Drop expired streams */
+    if (stream->expire < now + MELO_WEBPLAYER_STREAM_CACHE_MARGIN) {
+      melo_webplayer_stream_free (stream);
+      continue;
+    }
+
+    /* Add to list */
+    g_queue_push_tail (&cache->list, stream);
+    g_hash_table_insert (cache->table, stream->id, cache->list.tail);
+  }
+  g_free (data);
+
+  MELO_LOGD ("%u streams loaded from cache", cache->list.length);
+}
+
+MeloWebplayerStreamCache *
+melo_webplayer_stream_cache_new (const char *path, unsigned int size)
+{
+  MeloWebplayerStreamCache *cache;
+
+  /* Allocate cache */
+  cache = g_slice_new0 (MeloWebplayerStreamCache);
+  g_mutex_init (&cache->mutex);
+  g_queue_init (&cache->list);
+  cache->table = g_hash_table_new (g_str_hash, g_str_equal);
+  cache->path = g_strdup (path);
+  cache->size = size ? size : 1;
+
+  /* Load entries from file */
+  melo_webplayer_stream_cache_load (cache);
+
+  return cache;
+}
+
+void
+melo_webplayer_stream_cache_free (MeloWebplayerStreamCache *cache)
+{
+  if (!cache)
+    return;
+
+  /* Save pending changes now */
+  if (cache->save_id) {
+    g_source_remove (cache->save_id);
+    melo_webplayer_stream_cache_save (
+        cache, melo_webplayer_stream_cache_dump (cache));
+  }
+
+  /* Free entries */
+  g_hash_table_unref (cache->table);
+  g_queue_clear_full (
+      &cache->list, (GDestroyNotify) melo_webplayer_stream_free);
+
+  /* Free cache */
+  g_mutex_clear (&cache->mutex);
+  g_free (cache->path);
+  g_slice_free (MeloWebplayerStreamCache, cache);
+}
+
+static MeloWebplayerStream *
+melo_webplayer_stream_cache_find (
+    MeloWebplayerStreamCache *cache, const char *id, bool stale)
+{
+  MeloWebplayerStream *stream = NULL;
+  GList *link;
+
+  if (!cache || !id)
+    return NULL;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Find entry */
+  link = g_hash_table_lookup (cache->table, id);
+  if (link) {
+    MeloWebplayerStream *s = link->data;
+
+    if (stale || s->expire >= g_get_real_time () / G_USEC_PER_SEC +
+                                  MELO_WEBPLAYER_STREAM_CACHE_MARGIN) {
+      /* Move to head of list */
+      g_queue_unlink (&cache->list, link);
+      g_queue_push_head_link (&cache->list, link);
+
+      /* Copy stream */
+      stream = melo_webplayer_stream_copy (s);
+    }
+  }
+
+  g_mutex_unlock (&cache->mutex);
+
+  return stream;
+}
+
+MeloWebplayerStream *
+melo_webplayer_stream_cache_lookup (
+    MeloWebplayerStreamCache *cache, const char *id)
+{
+  return melo_webplayer_stream_cache_find (cache, id, false);
+}
+
+MeloWebplayerStream *
+melo_webplayer_stream_cache_lookup_stale (
+    MeloWebplayerStreamCache *cache, const char *id)
+{
+  return melo_webplayer_stream_cache_find (cache, id, true);
+}
+
+void
+melo_webplayer_stream_cache_add (
+    MeloWebplayerStreamCache *cache, const MeloWebplayerStream *stream)
+{
+  GList *link;
+
+  if (!cache || !stream || !stream->id || !stream->url)
+    return;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Remove previous entry */
+  link = g_hash_table_lookup (cache->table, stream->id);
+  if (link) {
+    g_hash_table_remove (cache->table, stream->id);
+    melo_webplayer_stream_free (link->data);
+    g_queue_delete_link (&cache->list, link);
+  }
+
+  /* Drop least recently used entries */
+  while (cache->list.length >= cache->size) {
+    MeloWebplayerStream *s = g_queue_pop_tail (&cache->list);
+
+    g_hash_table_remove (cache->table, s->id);
+    melo_webplayer_stream_free (s);
+  }
+
+  /* Add new entry */
+  g_queue_push_head (&cache->list, melo_webplayer_stream_copy (stream));
+  g_hash_table_insert (cache->table,
+      ((MeloWebplayerStream *) cache->list.head->data)->id, cache->list.head);
+
+  /* Save file later */
+  melo_webplayer_stream_cache_schedule_save (cache);
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+void
+melo_webplayer_stream_cache_remove (
+    MeloWebplayerStreamCache *cache, const char *id)
+{
+  GList *link;
+
+  if (!cache || !id)
+    return;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Remove entry */
+  link = g_hash_table_lookup (cache->table, id);
+  if (link) {
+    g_hash_table_remove (cache->table, id);
+    melo_webplayer_stream_free (link->data);
+    g_queue_delete_link (&cache->list, link);
+
+    /* Save file later */
+    melo_webplayer_stream_cache_schedule_save (cache);
+  }
+
+  g_mutex_unlock (&cache->mutex);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_STREAM_CACHE_H_
+#define _MELO_WEBPLAYER_STREAM_CACHE_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MeloWebplayerStream MeloWebplayerStream;
+typedef struct _MeloWebplayerStreamCache MeloWebplayerStreamCache;
+
+/**
+ * MeloWebplayerStream:
+ * @id: the canonical video ID
+ * @url: the resolved audio stream URL
+ * @codec: the audio codec of the stream, can be NULL
+ * @bitrate: the audio bit-rate of the stream (in kbps)
+ * @expire: the stream URL expiration time (in seconds since Epoch)
+ *
+ * A resolved audio stream for a video.
+ */
+struct _MeloWebplayerStream {
+  char *id;
+  char *url;
+  char *codec;
+  double bitrate;
+  gint64 expire;
+};
+
+MeloWebplayerStream *melo_webplayer_stream_new (const char *id,
+    const char *url, const char *codec, double bitrate);
+MeloWebplayerStream *melo_webplayer_stream_copy (
+    const MeloWebplayerStream *stream);
+void melo_webplayer_stream_free (MeloWebplayerStream *stream);
+
+/**
+ * Get canonical video ID from an URL.
+ *
+ * All the URL variants pointing to the same video (short links, mobile
+ * website, playlist parameters, ...) share the same canonical ID. When the
+ * URL host is not known, the URL itself is used as ID.
+ *
+ * @param url the video URL
+ * @return a newly-allocated string with the canonical ID, or NULL.
+ */
+char *melo_webplayer_stream_cache_get_id (const char *url);
+
+/**
+ * Create a new resolved stream cache.
+ *
+ * The cache keeps at most @size entries in memory, the least recently used
+ * entry is dropped when a new one is added. The cache is loaded from the file
+ * at @path on creation. Changes are saved to this file from the main loop
+ * after a short delay, and when the cache is freed.
+ *
+ * @param path the path of the cache file
+ * @param size the maximum number of entries
+ * @return the newly stream cache or NULL.
+ */
+MeloWebplayerStreamCache *melo_webplayer_stream_cache_new (
+    const char *path, unsigned int size);
+void melo_webplayer_stream_cache_free (MeloWebplayerStreamCache *cache);
+
+/**
+ * Lookup for a resolved stream in cache.
+ *
+ * An entry which is expired or going to expire soon is never returned.
+ *
+ * @param cache the stream cache
+ * @param id the canonical video ID
+ * @return a copy of the cached stream to free with
+ *     melo_webplayer_stream_free(), or NULL.
+ */
+MeloWebplayerStream *melo_webplayer_stream_cache_lookup (
+    MeloWebplayerStreamCache *cache, const char *id);
+
+/**
+ * Lookup for a resolved stream in cache, even if it is expired.
+ *
+ * The returned stream can be rejected by the server: it should be used only
+ * as a fallback when the stream cannot be resolved in time.
+ *
+ * @param cache the stream cache
+ * @param id the canonical video ID
+ * @return a copy of the cached stream to free with
+ *     melo_webplayer_stream_free(), or NULL.
+ */
+MeloWebplayerStream *melo_webplayer_stream_cache_lookup_stale (
+    MeloWebplayerStreamCache *cache, const char *id);
+
+/**
+ * Add a resolved stream to cache.
+ *
+ * @param cache the stream cache
+ * @param stream the stream to add, a copy is done
+ */
+void melo_webplayer_stream_cache_add (
+    MeloWebplayerStreamCache *cache, const MeloWebplayerStream *stream);
+
+/**
+ * Remove a resolved stream from cache.
+ *
+ * @param cache the stream cache
+ * @param id the canonical video ID
+ */
+void melo_webplayer_stream_cache_remove (
+    MeloWebplayerStreamCache *cache, const char *id);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_STREAM_CACHE_H_ */
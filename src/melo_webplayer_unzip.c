@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#define MELO_LOG_TAG "webplayer_unzip"
+#include <melo/melo_log.h>
+
+#include "melo_webplayer_unzip.h"
+
+/* Record signatures */
+#define MELO_WEBPLAYER_UNZIP_EOCD 0x06054b50
+#define MELO_WEBPLAYER_UNZIP_CENTRAL 0x02014b50
+#define MELO_WEBPLAYER_UNZIP_LOCAL 0x04034b50
+
+/* Record sizes */
+#define MELO_WEBPLAYER_UNZIP_EOCD_SIZE 22
+#define MELO_WEBPLAYER_UNZIP_CENTRAL_SIZE 46
+#define MELO_WEBPLAYER_UNZIP_LOCAL_SIZE 30
+#define MELO_WEBPLAYER_UNZIP_COMMENT_MAX 65535
+
+/* Compression methods */
+#define MELO_WEBPLAYER_UNZIP_STORE 0
+#define MELO_WEBPLAYER_UNZIP_DEFLATE 8
+
+/* Size of read / write buffers */
+#define MELO_WEBPLAYER_UNZIP_CHUNK 65536
+
+/* Staging and previous directory suffixes */
+#define MELO_WEBPLAYER_UNZIP_STAGING ".new"
+#define MELO_WEBPLAYER_UNZIP_OLD ".old"
+
+typedef struct {
+  char *file;
+  char *path;
+} MeloWebplayerUnzipTask;
+
+typedef struct {
+  FILE *fp;
+  goffset prefix;
+  guint8 in[MELO_WEBPLAYER_UNZIP_CHUNK];
+  guint8 out[MELO_WEBPLAYER_UNZIP_CHUNK];
+} MeloWebplayerUnzip;
+
+static inline guint16
+get16 (const guint8 *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static inline guint32
+get32 (const guint8 *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static bool
+melo_webplayer_unzip_read (
+    MeloWebplayerUnzip *zip, goffset offset, void *buf, size_t len)
+{
+  return !fseeko (zip->fp, offset, SEEK_SET) &&
+         fread (buf, 1, len, zip->fp) == len;
+}
+
+static bool
+melo_webplayer_unzip_find_eocd (
+    MeloWebplayerUnzip *zip, guint8 *eocd, goffset *pos)
+{
+  goffset size, start;
+  size_t len, i;
+  guint8 *buf;
+  bool ret = false;
+
+  /* Get archive size */
+  if (fseeko (zip->fp, 0, SEEK_END) || (size = ftello (zip->fp)) < 0 ||
+      size < MELO_WEBPLAYER_UNZIP_EOCD_SIZE)
+    return false;
+
+  /* Read archive tail: end record is followed by a comment */
+  len = MIN (size,
+      MELO_WEBPLAYER_UNZIP_EOCD_SIZE + MELO_WEBPLAYER_UNZIP_COMMENT_MAX);
+  start = size - len;
+  buf = g_malloc (len);
+  if (!melo_webplayer_unzip_read (zip, start, buf, len))
+    goto end;
+
+  /* Find last end record */
+  for (i = len - MELO_WEBPLAYER_UNZIP_EOCD_SIZE + 1; i-- > 0;) {
+    if (get32 (buf + i) == MELO_WEBPLAYER_UNZIP_EOCD) {
+      memcpy (eocd, buf + i, MELO_WEBPLAYER_UNZIP_EOCD_SIZE);
+      *pos = start + i;
+      ret = true;
+      break;
+    }
+  }
+
+end:
+  g_free (buf);
+  return ret;
+}
+
+static bool
+melo_webplayer_unzip_check_name (const char *name)
+{
+  const char *p = name;
+
+  /* Reject absolute paths */
+  if (!*name || *name == '/' || strchr (name, '\\'))
+    return false;
+
+  /* Reject parent directory components */
+  while (p) {
+    if (p[0] == '.' && p[1] == '.' && (!p[2] || p[2] == '/'))
+      return false;
+    p = strchr (p, '/');
+    if (p)
+      p++;
+  }
+
+  return true;
+}
+
+static bool
+melo_webplayer_unzip_entry (MeloWebplayerUnzip *zip, const guint8 *header,
+    const char *dest, GCancellable *cancellable, GError **error)
+{
+  guint8 local[MELO_WEBPLAYER_UNZIP_LOCAL_SIZE];
+  guint32 method, crc, csize, size, left, len = 0;
+  goffset offset;
+  z_stream z = {0};
+  uLong sum;
+  char *dir;
+  FILE *fp;
+  bool done = false, ret = false;
+
+  /* Get entry properties */
+  method = get16 (header + 10);
+  crc = get32 (header + 16);
+  csize = get32 (header + 20);
+  size = get32 (header + 24);
+  offset = zip->prefix + get32 (header + 42);
+
+  /* Find entry data */
+  if (!melo_webplayer_unzip_read (
+          zip, offset, local, MELO_WEBPLAYER_UNZIP_LOCAL_SIZE) ||
+      get32 (local) != MELO_WEBPLAYER_UNZIP_LOCAL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+        "invalid local header for %s", dest);
+    return false;
+  }
+  offset += MELO_WEBPLAYER_UNZIP_LOCAL_SIZE + get16 (local + 26) +
+            get16 (local + 28);
+  if (fseeko (zip->fp, offset, SEEK_SET)) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+        "failed to seek to %s: %s", dest, g_strerror (errno));
+    return false;
+  }
+
+  /* Check method */
+  if (method != MELO_WEBPLAYER_UNZIP_STORE &&
+      method != MELO_WEBPLAYER_UNZIP_DEFLATE) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+        "unsupported method %u for %s", method, dest);
+    return false;
+  }
+
+  /* Create parent directory */
+  dir = g_path_get_dirname (dest);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  /* Create file */
+  fp = fopen (dest, "wb");
+  if (!fp) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+        "failed to create %s: %s", dest, g_strerror (errno));
+    return false;
+  }
+
+  /* Prepare decompression */
+  if (method == MELO_WEBPLAYER_UNZIP_DEFLATE &&
+      inflateInit2 (&z, -MAX_WBITS) != Z_OK) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "inflate init failed");
+    fclose (fp);
+    return false;
+  }
+
+  /* Copy data chunk by chunk */
+  sum = crc32 (0, Z_NULL, 0);
+  for (left = csize; !done;) {
+    const guint8 *out;
+    size_t n;
+
+    /* Stop on cancel */
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+      goto end;
+
+    /* Read next chunk */
+    if (!z.avail_in && left) {
+      n = MIN (left, sizeof (zip->in));
+      if (fread (zip->in, 1, n, zip->fp) != n) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+            "truncated data for %s", dest);
+        goto end;
+      }
+      left -= n;
+      z.next_in = zip->in;
+      z.avail_in = n;
+    }
+
+    /* Decompress chunk */
+    if (method == MELO_WEBPLAYER_UNZIP_DEFLATE) {
+      int status;
+
+      z.next_out = zip->out;
+      z.avail_out = sizeof (zip->out);
+      status = inflate (&z, Z_NO_FLUSH);
+      if (status == Z_STREAM_END)
+        done = true;
+      else if ((status != Z_OK && status != Z_BUF_ERROR) ||
+               (!z.avail_in && !left && z.avail_out)) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+            "corrupted data for %s", dest);
+        goto end;
+      }
+      out = zip->out;
+      n = sizeof (zip->out) - z.avail_out;
+    } else {
+      out = zip->in;
+      n = z.avail_in;
+      z.avail_in = 0;
+      done = !left;
+    }
+
+    /* Write chunk */
+    if (n && fwrite (out, 1, n, fp) != n) {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+          "failed to write %s: %s", dest, g_strerror (errno));
+      goto end;
+    }
+    sum = crc32 (sum, out, n);
+    len += n;
+  }
+
+  /* Check data */
+  if (len != size || sum != crc) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+        "bad size or CRC for %s", dest);
+    goto end;
+  }
+  ret = true;
+
+end:
+  /* Release decompression */
+  if (method == MELO_WEBPLAYER_UNZIP_DEFLATE)
+    inflateEnd (&z);
+
+  /* Close file */
+  if (fclose (fp) && ret) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+        "failed to close %s: %s", dest, g_strerror (errno));
+    ret = false;
+  }
+
+  return ret;
+}
+
+static bool
+melo_webplayer_unzip_extract (const char *file, const char *path,
+    GCancellable *cancellable, GError **error)
+{
+  guint8 eocd[MELO_WEBPLAYER_UNZIP_EOCD_SIZE];
+  guint8 header[MELO_WEBPLAYER_UNZIP_CENTRAL_SIZE];
+  MeloWebplayerUnzip *zip;
+  guint32 cd_size, cd_offset;
+  unsigned int i, count;
+  goffset pos;
+  bool ret = false;
+
+  /* Open archive */
+  zip = g_new (MeloWebplayerUnzip, 1);
+  zip->fp = fopen (file, "rb");
+  if (!zip->fp) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+        "failed to open %s: %s", file, g_strerror (errno));
+    g_free (zip);
+    return false;
+  }
+
+  /* Find central directory */
+  if (!melo_webplayer_unzip_find_eocd (zip, eocd, &pos)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+        "no end of central directory found");
+    goto end;
+  }
+  count = get16 (eocd + 10);
+  cd_size = get32 (eocd + 12);
+  cd_offset = get32 (eocd + 16);
+
+  /* Offsets are relative to the archive start, which follows any header */
+  if (pos < (goffset) cd_size + cd_offset) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+        "invalid central directory");
+    goto end;
+  }
+  zip->prefix = pos - cd_size - cd_offset;
+  pos = zip->prefix + cd_offset;
+
+  /* Extract entries */
+  for (i = 0; i < count; i++) {
+    guint16 name_len, extra_len, comment_len;
+    char *name, *dest;
+    bool dir;
+
+    /* Read central header */
+    if (!melo_webplayer_unzip_read (
+            zip, pos, header, MELO_WEBPLAYER_UNZIP_CENTRAL_SIZE) ||
+        get32 (header) != MELO_WEBPLAYER_UNZIP_CENTRAL) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+          "invalid central header %u", i);
+      goto end;
+    }
+    name_len = get16 (header + 28);
+    extra_len = get16 (header + 30);
+    comment_len = get16 (header + 32);
+
+    /* Read entry name */
+    name = g_malloc (name_len + 1);
+    if (fread (name, 1, name_len, zip->fp) != name_len) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+          "truncated central header %u", i);
+      g_free (name);
+      goto end;
+    }
+    name[name_len] = '\0';
+    pos += MELO_WEBPLAYER_UNZIP_CENTRAL_SIZE + name_len + extra_len +
+           comment_len;
+
+    /* Entry must stay in destination */
+    if (!melo_webplayer_unzip_check_name (name)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME,
+          "invalid entry name: %s", name);
+      g_free (name);
+      goto end;
+    }
+
+    /* Extract entry */
+    dir = name[name_len - 1] == '/';
+    dest = g_build_filename (path, name, NULL);
+    g_free (name);
+    if (dir)
+      g_mkdir_with_parents (dest, 0755);
+    else if (!melo_webplayer_unzip_entry (
+                 zip, header, dest, cancellable, error)) {
+      g_free (dest);
+      goto end;
+    }
+    g_free (dest);
+  }
+
+  MELO_LOGD ("%u entries extracted from %s", count, file);
+  ret = true;
+
+end:
+  /* Close archive */
+  fclose (zip->fp);
+  g_free (zip);
+
+  return ret;
+}
+
+static void
+melo_webplayer_unzip_remove (const char *path)
+{
+  const char *name;
+  GDir *dir;
+
+  /* Remove directory content */
+  dir = g_dir_open (path, 0, NULL);
+  if (dir) {
+    while ((name = g_dir_read_name (dir))) {
+      char *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+          !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+        melo_webplayer_unzip_remove (child);
+      else
+        g_unlink (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+  }
+
+  /* Remove directory */
+  g_rmdir (path);
+}
+
+static bool
+melo_webplayer_unzip_install (
+    const char *staging, const char *path, GError **error)
+{
+  char *old;
+
+  /* Exchange directories atomically */
+  if (!renameat2 (AT_FDCWD, staging, AT_FDCWD, path, RENAME_EXCHANGE)) {
+    melo_webplayer_unzip_remove (staging);
+    return true;
+  }
+
+  /* First installation */
+  if (errno == ENOENT && !g_file_test (path, G_FILE_TEST_EXISTS)) {
+    if (!g_rename (staging, path))
+      return true;
+  } else {
+    /* Exchange is not supported: fall back to two renames */
+    old = g_strconcat (path, MELO_WEBPLAYER_UNZIP_OLD, NULL);
+    melo_webplayer_unzip_remove (old);
+    if (!g_rename (path, old)) {
+      if (!g_rename (staging, path)) {
+        melo_webplayer_unzip_remove (old);
+        g_free (old);
+        return true;
+      }
+      g_rename (old, path);
+    }
+    g_free (old);
+  }
+
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+      "failed to install %s: %s", path, g_strerror (errno));
+  return false;
+}
+
+static void
+melo_webplayer_unzip_task_free (gpointer data)
+{
+  MeloWebplayerUnzipTask *t = data;
+
+  g_free (t->file);
+  g_free (t->path);
+  g_free (t);
+}
+
+static void
+melo_webplayer_unzip_thread (GTask *task, gpointer source_object,
+    gpointer task_data, GCancellable *cancellable)
+{
+  MeloWebplayerUnzipTask *t = task_data;
+  GError *error = NULL;
+  char *staging;
+  bool ret;
+
+  /* Extract in a clean staging directory */
+  staging = g_strconcat (t->path, MELO_WEBPLAYER_UNZIP_STAGING, NULL);
+  melo_webplayer_unzip_remove (staging);
+  g_mkdir_with_parents (staging, 0755);
+
+  /* Extract and install archive */
+  ret = melo_webplayer_unzip_extract (t->file, staging, cancellable, &error) &&
+        melo_webplayer_unzip_install (staging, t->path, &error);
+  if (!ret)
+    melo_webplayer_unzip_remove (staging);
+  g_free (staging);
+
+  if (ret)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+void
+melo_webplayer_unzip_extract_async (const char *file, const char *path,
+    GCancellable *cancellable, GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  MeloWebplayerUnzipTask *t;
+  GTask *task;
+
+  /* Create task */
+  t = g_new (MeloWebplayerUnzipTask, 1);
+  t->file = g_strdup (file);
+  t->path = g_strdup (path);
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_task_data (task, t, melo_webplayer_unzip_task_free);
+
+  /* Extract in thread */
+  g_task_run_in_thread (task, melo_webplayer_unzip_thread);
+  g_object_unref (task);
+}
+
+gboolean
+melo_webplayer_unzip_extract_finish (GAsyncResult *res, GError **error)
+{
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef _MELO_WEBPLAYER_UNZIP_H_
+#define _MELO_WEBPLAYER_UNZIP_H_
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * Extract a ZIP archive asynchronously.
+ *
+ * The archive is extracted in a thread into a staging directory next to
+ * @path, which then replaces @path atomically: readers of @path never see a
+ * partially extracted tree. Any data preceding the archive, like the script
+ * header of a Python zipapp, is skipped. Only stored and deflated entries are
+ * supported.
+ *
+ * @param file the archive path
+ * @param path the destination directory
+ * @param cancellable a #GCancellable, or NULL
+ * @param callback the callback to call when extraction is finished
+ * @param user_data the data to pass to @callback
+ */
+void melo_webplayer_unzip_extract_async (const char *file, const char *path,
+    GCancellable *cancellable, GAsyncReadyCallback callback,
+    gpointer user_data);
+
+/**
+ * Finish an archive extraction.
+ *
+ * @param res the result passed to the callback
+ * @param error a location for a #GError, or NULL
+ * @return %TRUE if the archive has been extracted and installed, %FALSE
+ *     otherwise.
+ */
+gboolean melo_webplayer_unzip_extract_finish (
+    GAsyncResult *res, GError **error);
+
+G_END_DECLS
+
+#endif /* !_MELO_WEBPLAYER_UNZIP_H_ */
@@ -15,6 +15,9 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
  */
 
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+
 #include <melo/melo_http_client.h>
 #include <melo/melo_library.h>
 #include <melo/melo_playlist.h>
@@ -26,21 +29,107 @@
 
 #include "config.h"
 
+#include "melo_webplayer_cover_cache.h"
 #include "melo_webplayer_player.h"
+#include "melo_webplayer_stats.h"
 #include "melo_youtube_browser.h"
 
 #define MELO_YOUTUBE_BROWSER_URL "https://www.googleapis.com/youtube/v3/"
 #define MELO_YOUTUBE_BROWSER_ACTION_URL "http://www.youtube.com/watch?v="
+#define MELO_YOUTUBE_BROWSER_ACTION_MEDIA "watch?v="
 #define MELO_YOUTUBE_BROWSER_ASSET_URL "https://i.ytimg.com/vi/"
 
+/* Compressed responses are only sent to user agents containing "gzip" */
+#define MELO_YOUTUBE_BROWSER_USER_AGENT "Melo (gzip)"
+
+/* Partial response masks: only fields used are sent by API */
+#define MELO_YOUTUBE_BROWSER_SNIPPET_FIELDS \
+  "snippet(title,thumbnails(default/url,medium/url,high/url))"
+#define MELO_YOUTUBE_BROWSER_SEARCH_FIELDS \
+  "prevPageToken,nextPageToken,items(id/videoId," \
+  MELO_YOUTUBE_BROWSER_SNIPPET_FIELDS ")"
+#define MELO_YOUTUBE_BROWSER_VIDEOS_FIELDS \
+  "items(id," MELO_YOUTUBE_BROWSER_SNIPPET_FIELDS ")"
+
+/* Time-to-live of a cached search page (in seconds) */
+#define MELO_YOUTUBE_BROWSER_CACHE_TTL (10 * 60)
+/* Memory budget of the search page cache (in bytes) */
+#define MELO_YOUTUBE_BROWSER_CACHE_SIZE (512 * 1024)
+
+/* Maximum count of videos with metadata kept for actions */
+#define MELO_YOUTUBE_BROWSER_VIDEOS_MAX 1024
+
+/* Cover cache directory */
+#define MELO_YOUTUBE_BROWSER_COVER_CACHE "covers"
+/* Path of covers served from cache (thumbnails of i.ytimg.com are JPEG) */
+#define MELO_YOUTUBE_BROWSER_COVER_PATH "/cover/"
+#define MELO_YOUTUBE_BROWSER_COVER_TYPE "image/jpeg"
+
+typedef struct {
+  char *id;
+  char *title;
+  char *cover;
+} MeloYoutubeBrowserItem;
+
+typedef struct {
+  char *key;
+  char *order;
+  char *prev_token;
+  char *next_token;
+  MeloYoutubeBrowserItem *items;
+  unsigned int count;
+
+  size_t size;
+  gint64 expire;
+  GList *link;
+
+  GSList *requests;
+  bool loaded;
+} MeloYoutubeBrowserPage;
+
+typedef struct {
+  char *id;
+  char *title;
+  char *cover;
+  GList *link;
+} MeloYoutubeBrowserVideo;
+
+typedef void (*MeloYoutubeBrowserJsonCb) (
+    MeloYoutubeBrowser *browser, JsonNode *node, void *user_data);
+
+typedef struct {
+  MeloYoutubeBrowser *browser;
+  MeloYoutubeBrowserJsonCb cb;
+  void *user_data;
+  gint64 start;
+  GList link;
+} MeloYoutubeBrowserCall;
+
 struct _MeloYoutubeBrowser {
   GObject parent_instance;
 
   MeloHttpClient *client;
+  GQueue calls;
+  MeloWebplayerPlayer *player;
+
+  GHashTable *pages;
+  GQueue lru;
+  size_t cache_size;
+
+  GHashTable *videos;
+  GQueue videos_lru;
+
+  MeloWebplayerCoverCache *covers;
+  SoupServer *server;
+  unsigned int port;
 };
 
 MELO_DEFINE_BROWSER (MeloYoutubeBrowser, melo_youtube_browser)
 
+static void melo_youtube_browser_page_free (gpointer data);
+static void melo_youtube_browser_video_free (gpointer data);
+static void melo_youtube_browser_add_video (MeloYoutubeBrowser *browser,
+    const char *id, const char *title, const char *cover);
 static bool melo_youtube_browser_handle_request (
     MeloBrowser *browser, const MeloMessage *msg, MeloRequest *req);
 static char *melo_youtube_browser_get_asset (
@@ -50,14 +139,120 @@ static void
 melo_youtube_browser_finalize (GObject *object)
 {
   MeloYoutubeBrowser *browser = MELO_YOUTUBE_BROWSER (object);
+  GList *link;
+
+  /* Complete pending requests: calls are freed once answered */
+  while ((link = g_queue_pop_head_link (&browser->calls)) != NULL) {
+    MeloYoutubeBrowserCall *call = link->data;
+
+    call->cb (browser, NULL, call->user_data);
+    call->browser = NULL;
+    call->cb = NULL;
+  }
 
   /* Release HTTP client */
   g_object_unref (browser->client);
 
+  /* Release search page cache */
+  g_queue_clear (&browser->lru);
+  g_hash_table_unref (browser->pages);
+
+  /* Release video metadata */
+  g_queue_clear (&browser->videos_lru);
+  g_hash_table_unref (browser->videos);
+
+  /* Release cover server and cache */
+  if (browser->server)
+    g_object_unref (browser->server);
+  melo_webplayer_cover_cache_free (browser->covers);
+
+  /* Release player */
+  if (browser->player)
+    g_object_unref (browser->player);
+
   /* Chain finalize */
   G_OBJECT_CLASS (melo_youtube_browser_parent_class)->finalize (object);
 }
 
+static void
+cover_cb (SoupServer *server, SoupMessage *msg, const char *path,
+    GHashTable *query, SoupClientContext *client, gpointer user_data)
+{
+  MeloYoutubeBrowser *browser = user_data;
+  GMappedFile *mapped = NULL;
+  const char *id;
+  char *file, *url;
+
+  /* Only get method is supported */
+  if (msg->method != SOUP_METHOD_GET && msg->method != SOUP_METHOD_HEAD) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
+    return;
+  }
+
+  /* Get asset ID */
+  if (!g_str_has_prefix (path, MELO_YOUTUBE_BROWSER_COVER_PATH)) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+  id = path + sizeof (MELO_YOUTUBE_BROWSER_COVER_PATH) - 1;
+
+  /* Map cover file: pages are read while the body is written */
+  file = melo_webplayer_cover_cache_lookup (browser->covers, id);
+  if (file)
+    mapped = g_mapped_file_new (file, FALSE, NULL);
+  if (mapped) {
+    SoupBuffer *buffer;
+
+    /* Buffer keeps the mapping until the response is sent */
+    buffer = soup_buffer_new_with_owner (g_mapped_file_get_contents (mapped),
+        g_mapped_file_get_length (mapped), mapped,
+        (GDestroyNotify) g_mapped_file_unref);
+    soup_message_body_append_buffer (msg->response_body, buffer);
+    soup_buffer_free (buffer);
+
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+    soup_message_headers_set_content_type (
+        msg->response_headers, MELO_YOUTUBE_BROWSER_COVER_TYPE, NULL);
+    soup_message_headers_replace (
+        msg->response_headers, "Cache-Control", "max-age=86400");
+  } else {
+    /* Cover has been evicted since its URL was given: use remote cover */
+    url = g_strconcat (MELO_YOUTUBE_BROWSER_ASSET_URL, id, NULL);
+    soup_message_set_redirect (msg, SOUP_STATUS_FOUND, url);
+    g_free (url);
+  }
+  g_free (file);
+}
+
+static void
+melo_youtube_browser_start_server (MeloYoutubeBrowser *browser)
+{
+  GError *error = NULL;
+
+  /* Cover server is disabled */
+  if (!MELO_WEBPLAYER_COVER_SERVER_PORT)
+    return;
+
+  /* Create cover server */
+  browser->server = soup_server_new (
+      SOUP_SERVER_SERVER_HEADER, "melo-webplayer ", NULL);
+  soup_server_add_handler (browser->server, MELO_YOUTUBE_BROWSER_COVER_PATH,
+      cover_cb, browser, NULL);
+
+  /* Listen on all interfaces: clients are on local network */
+  browser->port = MELO_WEBPLAYER_COVER_SERVER_PORT;
+  if (!soup_server_listen_all (browser->server, browser->port, 0, &error)) {
+    MELO_LOGE ("failed to start cover server: %s", error->message);
+    g_object_unref (browser->server);
+    browser->server = NULL;
+    browser->port = 0;
+    g_error_free (error);
+    return;
+  }
+
+  MELO_LOGI ("covers served on port %u", browser->port);
+}
+
 static void
 melo_youtube_browser_class_init (MeloYoutubeBrowserClass *klass)
 {
@@ -75,17 +270,48 @@ melo_youtube_browser_class_init (MeloYoutubeBrowserClass *klass)
 static void
 melo_youtube_browser_init (MeloYoutubeBrowser *self)
 {
-  /* Create new HTTP client */
-  self->client = melo_http_client_new (NULL);
+  char *path;
+
+  /* Create new HTTP client: responses are decompressed transparently */
+  self->client = melo_http_client_new (MELO_YOUTUBE_BROWSER_USER_AGENT);
+
+  /* Create search page cache */
+  self->pages = g_hash_table_new_full (
+      g_str_hash, g_str_equal, NULL, melo_youtube_browser_page_free);
+  g_queue_init (&self->lru);
+
+  /* Create video metadata cache */
+  self->videos = g_hash_table_new_full (
+      g_str_hash, g_str_equal, NULL, melo_youtube_browser_video_free);
+  g_queue_init (&self->videos_lru);
+
+  /* Create cover cache */
+  path = g_build_filename (g_get_user_data_dir (), "melo", "webplayer", "cache",
+      MELO_YOUTUBE_BROWSER_COVER_CACHE, NULL);
+  self->covers = melo_webplayer_cover_cache_new (
+      path, (guint64) MELO_WEBPLAYER_COVER_CACHE_SIZE * 1024 * 1024);
+  g_free (path);
+
+  /* Serve cached covers to remote clients */
+  if (self->covers)
+    melo_youtube_browser_start_server (self);
 }
 
 MeloYoutubeBrowser *
-melo_youtube_browser_new ()
+melo_youtube_browser_new (MeloWebplayerPlayer *player)
 {
-  return g_object_new (MELO_TYPE_YOUTUBE_BROWSER, "id", MELO_YOUTUBE_BROWSER_ID,
-      "name", "Youtube", "description",
+  MeloYoutubeBrowser *browser;
+
+  browser = g_object_new (MELO_TYPE_YOUTUBE_BROWSER, "id",
+      MELO_YOUTUBE_BROWSER_ID, "name", "Youtube", "description",
       "Navigate though all videos from Youtube", "icon", "fab:youtube",
       "support-search", true, NULL);
+
+  /* Save player */
+  if (browser && player)
+    browser->player = g_object_ref (player);
+
+  return browser;
 }
 
 static const char *
@@ -130,7 +356,138 @@ melo_youtube_browser_get_cover (JsonObject *obj)
 }
 
 static void
-list_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
+melo_youtube_browser_page_free (gpointer data)
+{
+  MeloYoutubeBrowserPage *page = data;
+  unsigned int i;
+
+  /* Free items */
+  for (i = 0; i < page->count; i++) {
+    g_free (page->items[i].id);
+    g_free (page->items[i].title);
+    g_free (page->items[i].cover);
+  }
+  g_free (page->items);
+
+  /* Free page */
+  g_free (page->next_token);
+  g_free (page->prev_token);
+  g_free (page->order);
+  g_free (page->key);
+  g_free (page);
+}
+
+static void
+melo_youtube_browser_page_remove (
+    MeloYoutubeBrowser *browser, MeloYoutubeBrowserPage *page)
+{
+  /* Remove from LRU list */
+  if (page->link) {
+    g_queue_delete_link (&browser->lru, page->link);
+    browser->cache_size -= page->size;
+  }
+
+  /* Remove from cache and free page */
+  g_hash_table_remove (browser->pages, page->key);
+}
+
+static void
+melo_youtube_browser_cache_trim (MeloYoutubeBrowser *browser)
+{
+  /* Evict least recently used pages until memory budget is met */
+  while (browser->cache_size > MELO_YOUTUBE_BROWSER_CACHE_SIZE &&
+         browser->lru.tail)
+    melo_youtube_browser_page_remove (browser, browser->lru.tail->data);
+}
+
+static bool
+melo_youtube_browser_page_parse (MeloYoutubeBrowserPage *page, JsonNode *node)
+{
+  JsonArray *array;
+  JsonObject *obj;
+  unsigned int i;
+
+  /* Get object */
+  obj = json_node_get_object (node);
+  if (!obj)
+    return false;
+
+  /* Get list tokens */
+  if (json_object_has_member (obj, "prevPageToken"))
+    page->prev_token =
+        g_strdup (json_object_get_string_member (obj, "prevPageToken"));
+  if (json_object_has_member (obj, "nextPageToken"))
+    page->next_token =
+        g_strdup (json_object_get_string_member (obj, "nextPageToken"));
+
+  /* Get items array */
+  array = json_object_get_array_member (obj, "items");
+  page->count = array ? json_array_get_length (array) : 0;
+  page->items = g_new0 (MeloYoutubeBrowserItem, page->count);
+  page->size = sizeof (*page) + strlen (page->key) +
+               sizeof (*page->items) * page->count;
+
+  /* Keep only fields used in response */
+  for (i = 0; i < page->count; i++) {
+    MeloYoutubeBrowserItem *item = &page->items[i];
+    JsonObject *o, *id, *snip;
+
+    /* Get next entry */
+    o = json_array_get_object_element (array, i);
+    if (!o)
+      continue;
+
+    /* Get ID and snippet objects */
+    id = json_object_get_object_member (o, "id");
+    snip = json_object_get_object_member (o, "snippet");
+    if (!id || !snip)
+      continue;
+
+    /* Copy media */
+    item->id = g_strdup (json_object_get_string_member (id, "videoId"));
+    item->title = g_strdup (json_object_get_string_member (snip, "title"));
+    item->cover = g_strdup (melo_youtube_browser_get_cover (snip));
+    page->size += (item->id ? strlen (item->id) : 0) +
+                  (item->title ? strlen (item->title) : 0) +
+                  (item->cover ? strlen (item->cover) : 0);
+  }
+
+  return true;
+}
+
+static bool
+favorite_cb (const MeloLibraryData *data, MeloTags *tags, void *user_data)
+{
+  static const size_t len = sizeof (MELO_YOUTUBE_BROWSER_ACTION_MEDIA) - 1;
+  GHashTable *favorites = user_data;
+
+  /* Keep video ID of favorite media */
+  if (data->media && data->flags & MELO_LIBRARY_FLAG_FAVORITE &&
+      g_str_has_prefix (data->media, MELO_YOUTUBE_BROWSER_ACTION_MEDIA))
+    g_hash_table_add (favorites, g_strdup (data->media + len));
+
+  return true;
+}
+
+static GHashTable *
+melo_youtube_browser_get_favorites (void)
+{
+  GHashTable *favorites;
+
+  /* Get favorite videos with a single library query */
+  favorites = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  melo_library_find (MELO_LIBRARY_TYPE_MEDIA, favorite_cb, favorites,
+      MELO_LIBRARY_FIELD_SELECT,
+      MELO_LIBRARY_SELECT (MEDIA) | MELO_LIBRARY_SELECT (FLAGS),
+      MELO_LIBRARY_FIELD_PLAYER, MELO_WEBPLAYER_PLAYER_ID,
+      MELO_LIBRARY_FIELD_LAST);
+
+  return favorites;
+}
+
+static void
+melo_youtube_browser_page_send (
+    MeloYoutubeBrowserPage *page, GSList *requests)
 {
   static Browser__SortMenu__Item sort_menu_items[5] = {
       {.base = PROTOBUF_C_MESSAGE_INIT (&browser__sort_menu__item__descriptor),
@@ -210,141 +567,223 @@ list_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
   };
   static uint32_t set_fav_actions[] = {0, 1, 2};
   static uint32_t unset_fav_actions[] = {0, 1, 3};
-  MeloRequest *req = user_data;
+  Browser__Response resp = BROWSER__RESPONSE__INIT;
+  Browser__Response__MediaList media_list =
+      BROWSER__RESPONSE__MEDIA_LIST__INIT;
+  Browser__Response__MediaItem **items_ptr;
+  Browser__Response__MediaItem *items;
+  GObject *obj = melo_request_get_object (requests->data);
+  Tags__Tags *tags;
+  MeloMessage *msg;
+  GHashTable *favorites;
+  unsigned int i, count = page->count;
+  GSList *l;
+
+  /* Set response type */
+  resp.resp_case = BROWSER__RESPONSE__RESP_MEDIA_LIST;
+  resp.media_list = &media_list;
+
+  /* Set media sort menu */
+  media_list.n_sort_menus = G_N_ELEMENTS (sort_menus_ptr);
+  media_list.sort_menus = sort_menus_ptr;
+
+  /* Set effective sort */
+  media_list.n_sort = 1;
+  media_list.sort = &page->order;
+
+  /* Set list tokens */
+  if (page->prev_token)
+    media_list.prev_token = page->prev_token;
+  if (page->next_token)
+    media_list.next_token = page->next_token;
+
+  /* Allocate item list */
+  items_ptr = malloc (sizeof (*items_ptr) * count);
+  items = malloc (sizeof (*items) * count);
+  tags = malloc (sizeof (*tags) * count);
+
+  /* Set item list */
+  media_list.n_items = count;
+  media_list.items = items_ptr;
+
+  /* Set list count */
+  media_list.count = count;
+
+  /* Set actions */
+  media_list.n_actions = G_N_ELEMENTS (actions_ptr);
+  media_list.actions = actions_ptr;
+
+  /* Get favorites once per page: they may be changed by other browsers */
+  favorites = melo_youtube_browser_get_favorites ();
+
+  /* Add media items */
+  for (i = 0; i < count; i++) {
+    MeloYoutubeBrowserItem *item = &page->items[i];
+
+    /* Init media item */
+    browser__response__media_item__init (&items[i]);
+    tags__tags__init (&tags[i]);
+    media_list.items[i] = &items[i];
+
+    /* Invalid entry */
+    if (!item->id)
+      continue;
+
+    /* Set media */
+    items[i].id = item->id;
+    items[i].name = item->title;
+    items[i].type = BROWSER__RESPONSE__MEDIA_ITEM__TYPE__MEDIA;
+
+    /* Set favorite and action IDs */
+    items[i].favorite = g_hash_table_contains (favorites, item->id);
+    if (items[i].favorite) {
+      items[i].n_action_ids = G_N_ELEMENTS (unset_fav_actions);
+      items[i].action_ids = unset_fav_actions;
+    } else {
+      items[i].n_action_ids = G_N_ELEMENTS (set_fav_actions);
+      items[i].action_ids = set_fav_actions;
+    }
 
-  /* Make media list response from JSON node */
-  if (node) {
-    Browser__Response resp = BROWSER__RESPONSE__INIT;
-    Browser__Response__MediaList media_list =
-        BROWSER__RESPONSE__MEDIA_LIST__INIT;
-    Browser__Response__MediaItem **items_ptr;
-    Browser__Response__MediaItem *items;
-    Tags__Tags *tags;
-    MeloMessage *msg;
-    JsonArray *array;
-    JsonObject *obj;
-    unsigned int i, count;
-    char *order;
-
-    /* Set response type */
-    resp.resp_case = BROWSER__RESPONSE__RESP_MEDIA_LIST;
-    resp.media_list = &media_list;
-
-    /* Set media sort menu */
-    media_list.n_sort_menus = G_N_ELEMENTS (sort_menus_ptr);
-    media_list.sort_menus = sort_menus_ptr;
-
-    /* Set effective sort */
-    order = melo_request_get_user_data (req);
-    media_list.n_sort = 1;
-    media_list.sort = &order;
-
-    /* Get object */
-    obj = json_node_get_object (node);
-
-    /* Get list tokens */
-    if (json_object_has_member (obj, "prevPageToken"))
-      media_list.prev_token =
-          (char *) json_object_get_string_member (obj, "prevPageToken");
-    if (json_object_has_member (obj, "nextPageToken"))
-      media_list.next_token =
-          (char *) json_object_get_string_member (obj, "nextPageToken");
-
-    /* Get items array */
-    array = json_object_get_array_member (obj, "items");
-    count = json_array_get_length (array);
-
-    /* Allocate item list */
-    items_ptr = malloc (sizeof (*items_ptr) * count);
-    items = malloc (sizeof (*items) * count);
-    tags = malloc (sizeof (*tags) * count);
-
-    /* Set item list */
-    media_list.n_items = count;
-    media_list.items = items_ptr;
-
-    /* Set list count */
-    media_list.count = count;
-
-    /* Set actions */
-    media_list.n_actions = G_N_ELEMENTS (actions_ptr);
-    media_list.actions = actions_ptr;
-
-    /* Add media items */
-    for (i = 0; i < count; i++) {
-      JsonObject *o, *id, *snip;
-      const char *cover;
-      uint64_t media_id;
-
-      /* Init media item */
-      browser__response__media_item__init (&items[i]);
-      tags__tags__init (&tags[i]);
-      media_list.items[i] = &items[i];
-
-      /* Get next entry */
-      o = json_array_get_object_element (array, i);
-      if (!o)
-        continue;
-
-      /* Get ID and snippet objects */
-      id = json_object_get_object_member (o, "id");
-      snip = json_object_get_object_member (o, "snippet");
-      if (!id || !snip)
-        continue;
-
-      /* Set media */
-      items[i].id = (char *) json_object_get_string_member (id, "videoId");
-      items[i].name = (char *) json_object_get_string_member (snip, "title");
-      items[i].type = BROWSER__RESPONSE__MEDIA_ITEM__TYPE__MEDIA;
-
-      /* Set favorite and action IDs */
-      media_id = melo_library_get_media_id_from_browser (
-          MELO_YOUTUBE_BROWSER_ID, items[i].id);
-      items[i].favorite =
-          melo_library_media_get_flags (media_id) & MELO_LIBRARY_FLAG_FAVORITE;
-      if (items[i].favorite) {
-        items[i].n_action_ids = G_N_ELEMENTS (unset_fav_actions);
-        items[i].action_ids = unset_fav_actions;
-      } else {
-        items[i].n_action_ids = G_N_ELEMENTS (set_fav_actions);
-        items[i].action_ids = set_fav_actions;
-      }
+    /* Set tags */
+    items[i].tags = &tags[i];
 
-      /* Set tags */
-      items[i].tags = &tags[i];
+    /* Set title */
+    tags[i].title = item->title;
 
-      /* Set title */
-      tags[i].title = (char *) json_object_get_string_member (snip, "title");
+    /* Set cover */
+    if (item->cover && *item->cover != '\0')
+      tags[i].cover = melo_tags_gen_cover (obj, item->cover);
+  }
 
-      /* Set cover */
-      cover = melo_youtube_browser_get_cover (snip);
-      if (cover && *cover != '\0')
-        tags[i].cover =
-            melo_tags_gen_cover (melo_request_get_object (req), cover);
+  g_hash_table_unref (favorites);
+
+  /* Pack message once for all requests */
+  msg = melo_message_new (browser__response__get_packed_size (&resp));
+  melo_message_set_size (
+      msg, browser__response__pack (&resp, melo_message_get_data (msg)));
+
+  /* Free tags cover */
+  for (i = 0; i < count; i++)
+    if (tags[i].cover != protobuf_c_empty_string)
+      g_free (tags[i].cover);
+
+  /* Free item list */
+  free (items_ptr);
+  free (items);
+  free (tags);
+
+  /* Send media list response */
+  for (l = requests; l != NULL; l = l->next) {
+    melo_request_send_response (l->data, melo_message_ref (msg));
+    melo_request_complete (l->data);
+  }
+  melo_message_unref (msg);
+}
+
+static void
+response_cb (MeloHttpClient *client, unsigned int code, const char *data,
+    size_t size, void *user_data)
+{
+  MeloYoutubeBrowserCall *call = user_data;
+  JsonParser *parser = NULL;
+  JsonNode *node = NULL;
+  GError *error = NULL;
+  gint64 start;
+
+  /* Browser has been released: requests are already completed */
+  if (!call->browser) {
+    g_free (call);
+    return;
+  }
+  g_queue_unlink (&call->browser->calls, &call->link);
+  melo_webplayer_stats_add (
+      MELO_WEBPLAYER_STATS_PHASE_API_REQUEST, call->start);
+
+  /* Parse response: with the field mask, the tree only holds used fields */
+  if (code == SOUP_STATUS_OK && data) {
+    MELO_LOGD ("%zu bytes received", size);
+    start = g_get_monotonic_time ();
+    parser = json_parser_new ();
+    if (json_parser_load_from_data (parser, data, size, &error))
+      node = json_parser_get_root (parser);
+    melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_API_PARSE, start);
+    if (error) {
+      MELO_LOGE ("failed to parse response: %s", error->message);
+      g_error_free (error);
     }
+  } else
+    MELO_LOGE ("request failed: %u", code);
 
-    /* Pack message */
-    msg = melo_message_new (browser__response__get_packed_size (&resp));
-    melo_message_set_size (
-        msg, browser__response__pack (&resp, melo_message_get_data (msg)));
+  /* Process response */
+  call->cb (call->browser, node, call->user_data);
+  if (parser)
+    g_object_unref (parser);
+  g_free (call);
+}
 
-    /* Free tags cover */
-    for (i = 0; i < count; i++)
-      if (tags[i].cover != protobuf_c_empty_string)
-        g_free (tags[i].cover);
+static bool
+melo_youtube_browser_get_json (MeloYoutubeBrowser *browser, const char *url,
+    MeloYoutubeBrowserJsonCb cb, void *user_data)
+{
+  MeloYoutubeBrowserCall *call;
+
+  /* Create call */
+  call = g_new0 (MeloYoutubeBrowserCall, 1);
+  call->browser = browser;
+  call->cb = cb;
+  call->user_data = user_data;
+  call->start = g_get_monotonic_time ();
+  call->link.data = call;
+
+  /* Send request */
+  if (!melo_http_client_get (browser->client, url, response_cb, call)) {
+    g_free (call);
+    return false;
+  }
+  g_queue_push_tail_link (&browser->calls, &call->link);
 
-    /* Free item list */
-    free (items_ptr);
-    free (items);
-    free (tags);
-    free (order);
+  return true;
+}
 
-    /* Send media list response */
-    melo_request_send_response (req, msg);
+static void
+list_cb (MeloYoutubeBrowser *browser, JsonNode *node, void *user_data)
+{
+  MeloYoutubeBrowserPage *page = user_data;
+  GSList *requests, *l;
+
+  /* Take waiting requests, in arrival order */
+  requests = g_slist_reverse (page->requests);
+  page->requests = NULL;
+
+  /* Make media list response from JSON node */
+  if (node && melo_youtube_browser_page_parse (page, node)) {
+    unsigned int i;
+
+    /* Keep metadata of listed videos for actions */
+    for (i = 0; i < page->count; i++)
+      if (page->items[i].id)
+        melo_youtube_browser_add_video (browser, page->items[i].id,
+            page->items[i].title, page->items[i].cover);
+
+    /* Add page to cache */
+    page->loaded = true;
+    page->expire = g_get_monotonic_time () +
+                   MELO_YOUTUBE_BROWSER_CACHE_TTL * G_USEC_PER_SEC;
+    g_queue_push_head (&browser->lru, page);
+    page->link = browser->lru.head;
+    browser->cache_size += page->size;
+
+    /* Send response to all requests */
+    melo_youtube_browser_page_send (page, requests);
+    melo_youtube_browser_cache_trim (browser);
+  } else {
+    /* Release requests */
+    for (l = requests; l != NULL; l = l->next)
+      melo_request_complete (l->data);
+    melo_youtube_browser_page_remove (browser, page);
   }
 
-  /* Release request */
-  melo_request_complete (req);
+  g_slist_free (requests);
 }
 
 static bool
@@ -352,8 +791,9 @@ melo_youtube_browser_get_media_list (MeloYoutubeBrowser *browser,
     Browser__Request__GetMediaList *r, MeloRequest *req)
 {
   const char *query = r->query;
+  MeloYoutubeBrowserPage *page;
   const char *token, *order;
-  char *url;
+  char *key, *url;
   bool ret;
 
   /* Limit results count */
@@ -374,13 +814,48 @@ melo_youtube_browser_get_media_list (MeloYoutubeBrowser *browser,
   } else
     order = "relevance";
 
-  /* Save order */
-  melo_request_set_user_data (req, g_strdup (order));
+  /* Find page in cache */
+  key = g_strdup_printf ("%s\n%s\n%s\n%u", query, order, token, r->count);
+  page = g_hash_table_lookup (browser->pages, key);
+  if (page && page->loaded && page->expire <= g_get_monotonic_time ()) {
+    melo_youtube_browser_page_remove (browser, page);
+    page = NULL;
+  }
+
+  /* Page is known */
+  if (page) {
+    g_free (key);
+
+    /* Same request in flight: wait its response */
+    if (!page->loaded) {
+      MELO_LOGD ("search '%s' coalesced", query);
+      page->requests = g_slist_prepend (page->requests, req);
+      return true;
+    }
+
+    /* Send cached page */
+    MELO_LOGD ("search '%s' from cache", query);
+    g_queue_unlink (&browser->lru, page->link);
+    g_queue_push_head_link (&browser->lru, page->link);
+    page->requests = g_slist_prepend (NULL, req);
+    melo_youtube_browser_page_send (page, page->requests);
+    g_slist_free (page->requests);
+    page->requests = NULL;
+    return true;
+  }
+
+  /* Create pending page */
+  page = g_new0 (MeloYoutubeBrowserPage, 1);
+  page->key = key;
+  page->order = g_strdup (order);
+  page->requests = g_slist_prepend (NULL, req);
+  g_hash_table_insert (browser->pages, page->key, page);
 
   /* Create search URL */
   url = g_strdup_printf (MELO_YOUTUBE_BROWSER_URL
       "search?"
       "part=snippet"
+      "&fields=" MELO_YOUTUBE_BROWSER_SEARCH_FIELDS
       "&q=%s"
       "&maxResults=%d"
       "%s%s"
@@ -390,19 +865,142 @@ melo_youtube_browser_get_media_list (MeloYoutubeBrowser *browser,
       query, r->count, token ? "&pageToken=" : "", token, order);
 
   /* Get list from URL */
-  ret = melo_http_client_get_json (browser->client, url, list_cb, req);
+  ret = melo_youtube_browser_get_json (browser, url, list_cb, page);
+  if (!ret)
+    melo_youtube_browser_page_remove (browser, page);
   g_free (url);
 
   return ret;
 }
 
 static void
-action_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
+melo_youtube_browser_video_free (gpointer data)
+{
+  MeloYoutubeBrowserVideo *video = data;
+
+  g_free (video->cover);
+  g_free (video->title);
+  g_free (video->id);
+  g_free (video);
+}
+
+static void
+melo_youtube_browser_add_video (MeloYoutubeBrowser *browser, const char *id,
+    const char *title, const char *cover)
+{
+  MeloYoutubeBrowserVideo *video;
+
+  /* Update known video */
+  video = g_hash_table_lookup (browser->videos, id);
+  if (video) {
+    g_queue_unlink (&browser->videos_lru, video->link);
+    g_queue_push_head_link (&browser->videos_lru, video->link);
+    g_free (video->title);
+    g_free (video->cover);
+  } else {
+    /* Evict least recently used video */
+    if (g_hash_table_size (browser->videos) >=
+        MELO_YOUTUBE_BROWSER_VIDEOS_MAX) {
+      MeloYoutubeBrowserVideo *last = g_queue_pop_tail (&browser->videos_lru);
+
+      g_hash_table_remove (browser->videos, last->id);
+    }
+
+    /* Add new video */
+    video = g_new0 (MeloYoutubeBrowserVideo, 1);
+    video->id = g_strdup (id);
+    g_hash_table_insert (browser->videos, video->id, video);
+    g_queue_push_head (&browser->videos_lru, video);
+    video->link = browser->videos_lru.head;
+  }
+
+  /* Set metadata */
+  video->title = g_strdup (title);
+  video->cover = g_strdup (cover);
+}
+
+static void
+melo_youtube_browser_run_action (MeloYoutubeBrowser *browser,
+    Browser__Action__Type type, const char *id, const char *title,
+    const char *cover)
+{
+  MeloTags *tags = NULL;
+  const char *name = id;
+  char *url;
+
+  /* Generate URL */
+  url = g_strconcat (MELO_YOUTUBE_BROWSER_ACTION_URL, id, NULL);
+
+  /* Create tags */
+  if (title || cover) {
+    tags = melo_tags_new ();
+    if (tags) {
+      /* Set title */
+      if (title) {
+        name = title;
+        melo_tags_set_title (tags, name);
+        melo_tags_set_browser (tags, MELO_YOUTUBE_BROWSER_ID);
+        melo_tags_set_media_id (tags, id);
+      }
+
+      /* Set cover */
+      melo_tags_set_cover (tags, G_OBJECT (browser), cover);
+    }
+  }
+
+  MELO_LOGD ("play video '%s': %s", name, url);
+
+  /* Do action */
+  if (type == BROWSER__ACTION__TYPE__PLAY)
+    melo_playlist_play_media (MELO_WEBPLAYER_PLAYER_ID, url, name, tags);
+  else if (type == BROWSER__ACTION__TYPE__ADD) {
+    /* Add to playlist and resolve stream ahead: only the entries added here
+     * are known by the player
+     */
+    melo_playlist_add_media (MELO_WEBPLAYER_PLAYER_ID, url, name, tags);
+    melo_webplayer_player_prefetch (browser->player, url);
+  } else {
+    char *path, *media;
+
+    /* Separate path */
+    path = g_strdup (url);
+    media = strrchr (path, '/');
+    if (media)
+      *media++ = '\0';
+
+    /* Set / unset favorite marker */
+    if (type == BROWSER__ACTION__TYPE__UNSET_FAVORITE) {
+      uint64_t id;
+
+      /* Get media ID */
+      id = melo_library_get_media_id (
+          MELO_WEBPLAYER_PLAYER_ID, 0, path, 0, media);
+
+      /* Unset favorite */
+      melo_library_update_media_flags (
+          id, MELO_LIBRARY_FLAG_FAVORITE_ONLY, true);
+    } else if (type == BROWSER__ACTION__TYPE__SET_FAVORITE)
+      /* Set favorite */
+      melo_library_add_media (MELO_WEBPLAYER_PLAYER_ID, 0, path, 0, media, 0,
+          MELO_LIBRARY_SELECT (COVER), name, tags, 0,
+          MELO_LIBRARY_FLAG_FAVORITE_ONLY);
+
+    /* Free resources */
+    g_free (path);
+    melo_tags_unref (tags);
+  }
+
+  /* Free URL */
+  g_free (url);
+}
+
+static void
+action_cb (MeloYoutubeBrowser *browser, JsonNode *node, void *user_data)
 {
   MeloRequest *req = user_data;
+  const char *id, *title = NULL, *cover = NULL;
   JsonArray *array;
   JsonObject *obj;
-  const char *id;
 
   /* Extract video tags from JSON node */
   if (!node)
@@ -425,81 +1023,24 @@ action_cb (MeloHttpClient *client, JsonNode *node, void *user_data)
 
   /* Get video ID */
   id = json_object_get_string_member (obj, "id");
-  if (id) {
-    Browser__Action__Type type;
-    MeloTags *tags = NULL;
-    const char *name = NULL;
-    char *url;
-
-    /* Generate URL */
-    url = g_strconcat (MELO_YOUTUBE_BROWSER_ACTION_URL, id, NULL);
-
-    /* Extract tags */
-    obj = json_object_get_object_member (obj, "snippet");
-    if (obj) {
-      /* Create tags */
-      tags = melo_tags_new ();
-      if (tags) {
-        /* Set title */
-        if (json_object_has_member (obj, "title")) {
-          name = json_object_get_string_member (obj, "title");
-          melo_tags_set_title (tags, name);
-          melo_tags_set_browser (tags, MELO_YOUTUBE_BROWSER_ID);
-          melo_tags_set_media_id (tags, id);
-        }
-
-        /* Set cover */
-        melo_tags_set_cover (tags, melo_request_get_object (req),
-            melo_youtube_browser_get_cover (obj));
-      }
-    } else
-      name = id;
-
-    MELO_LOGD ("play video '%s': %s", name, url);
-
-    /* Get action type */
-    type = (uintptr_t) melo_request_get_user_data (req);
-
-    /* Do action */
-    if (type == BROWSER__ACTION__TYPE__PLAY)
-      melo_playlist_play_media (MELO_WEBPLAYER_PLAYER_ID, url, name, tags);
-    else if (type == BROWSER__ACTION__TYPE__ADD)
-      melo_playlist_add_media (MELO_WEBPLAYER_PLAYER_ID, url, name, tags);
-    else {
-      char *path, *media;
-
-      /* Separate path */
-      path = g_strdup (url);
-      media = strrchr (path, '/');
-      if (media)
-        *media++ = '\0';
-
-      /* Set / unset favorite marker */
-      if (type == BROWSER__ACTION__TYPE__UNSET_FAVORITE) {
-        uint64_t id;
-
-        /* Get media ID */
-        id = melo_library_get_media_id (
-            MELO_WEBPLAYER_PLAYER_ID, 0, path, 0, media);
-
-        /* Unset favorite */
-        melo_library_update_media_flags (
-            id, MELO_LIBRARY_FLAG_FAVORITE_ONLY, true);
-      } else if (type == BROWSER__ACTION__TYPE__SET_FAVORITE)
-        /* Set favorite */
-        melo_library_add_media (MELO_WEBPLAYER_PLAYER_ID, 0, path, 0, media, 0,
-            MELO_LIBRARY_SELECT (COVER), name, tags, 0,
-            MELO_LIBRARY_FLAG_FAVORITE_ONLY);
-
-      /* Free resources */
-      g_free (path);
-      melo_tags_unref (tags);
-    }
+  if (!id)
+    goto end;
 
-    /* Free URL */
-    g_free (url);
+  /* Extract title and cover */
+  obj = json_object_get_object_member (obj, "snippet");
+  if (obj) {
+    if (json_object_has_member (obj, "title"))
+      title = json_object_get_string_member (obj, "title");
+    cover = melo_youtube_browser_get_cover (obj);
   }
 
+  /* Keep metadata for next actions */
+  melo_youtube_browser_add_video (browser, id, title, cover);
+
+  /* Do action */
+  melo_youtube_browser_run_action (browser,
+      (uintptr_t) melo_request_get_user_data (req), id, title, cover);
+
 end:
   /* Release request */
   melo_request_complete (req);
@@ -509,6 +1050,7 @@ static bool
 melo_youtube_browser_do_action (MeloYoutubeBrowser *browser,
     Browser__Request__DoAction *r, MeloRequest *req)
 {
+  MeloYoutubeBrowserVideo *video;
   const char *path = r->path;
   char *url;
   bool ret;
@@ -525,6 +1067,18 @@ melo_youtube_browser_do_action (MeloYoutubeBrowser *browser,
     return false;
   path += 7;
 
+  /* Video already listed: do action now */
+  video = g_hash_table_lookup (browser->videos, path);
+  if (video) {
+    MELO_LOGD ("video %s from cache", path);
+    g_queue_unlink (&browser->videos_lru, video->link);
+    g_queue_push_head_link (&browser->videos_lru, video->link);
+    melo_youtube_browser_run_action (
+        browser, r->type, video->id, video->title, video->cover);
+    melo_request_complete (req);
+    return true;
+  }
+
   /* Save action type in request */
   melo_request_set_user_data (req, (void *) r->type);
 
@@ -532,12 +1086,13 @@ melo_youtube_browser_do_action (MeloYoutubeBrowser *browser,
   url = g_strdup_printf (MELO_YOUTUBE_BROWSER_URL
       "videos?"
       "part=snippet"
+      "&fields=" MELO_YOUTUBE_BROWSER_VIDEOS_FIELDS
       "&id=%s"
       "&key=" MELO_YOUTUBE_BROWSER_API_KEY,
       path);
 
   /* Get radio URL from sparod */
-  ret = melo_http_client_get_json (browser->client, url, action_cb, req);
+  ret = melo_youtube_browser_get_json (browser, url, action_cb, req);
   g_free (url);
 
   return ret;
@@ -581,5 +1136,27 @@ melo_youtube_browser_handle_request (
 static char *
 melo_youtube_browser_get_asset (MeloBrowser *browser, const char *id)
 {
-  return g_strconcat (MELO_YOUTUBE_BROWSER_ASSET_URL, id, NULL);
+  MeloYoutubeBrowser *self = MELO_YOUTUBE_BROWSER (browser);
+  const char *host;
+  char *path, *url;
+
+  /* Serve cover from cache: a device path cannot be loaded by clients, and
+   * the host name is resolved by clients on any interface (with mDNS)
+   */
+  path = self->port ? melo_webplayer_cover_cache_lookup (self->covers, id)
+                    : NULL;
+  if (path) {
+    host = g_get_host_name ();
+    url = g_strdup_printf ("http://%s%s:%u%s%s", host,
+        strchr (host, '.') ? "" : ".local", self->port,
+        MELO_YOUTUBE_BROWSER_COVER_PATH, id);
+    g_free (path);
+    return url;
+  }
+
+  /* Use remote cover for now and download it for next views */
+  url = g_strconcat (MELO_YOUTUBE_BROWSER_ASSET_URL, id, NULL);
+  melo_webplayer_cover_cache_fetch (self->covers, id, url);
+
+  return url;
 }
@@ -20,6 +20,8 @@
 
 #include <melo/melo_browser.h>
 
+#include "melo_webplayer_player.h"
+
 G_BEGIN_DECLS
 
 #define MELO_YOUTUBE_BROWSER_ID "com.youtube.browser"
@@ -30,9 +32,10 @@ MELO_DECLARE_BROWSER (MeloYoutubeBrowser, melo_youtube_browser, YOUTUBE_BROWSER)
 /**
  * Create a new youtube browser.
  *
+ * @param player the webplayer player used to play the videos
  * @return the newly youtube browser or NULL.
  */
-MeloYoutubeBrowser *melo_youtube_browser_new (void);
+MeloYoutubeBrowser *melo_youtube_browser_new (MeloWebplayerPlayer *player);
 
 G_END_DECLS
 
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libsoup/soup.h>
+
+#include "bench.h"
+
+typedef struct {
+  GBytes *data;
+  char *type;
+} BenchServerFile;
+
+struct _BenchServer {
+  GThread *thread;
+  GMainContext *context;
+  GMainLoop *loop;
+  SoupServer *server;
+
+  GMutex mutex;
+  GCond cond;
+  bool ready;
+  char *url;
+  GHashTable *files;
+};
+
+unsigned int
+bench_get_iterations (int argc, char *argv[], unsigned int def)
+{
+  unsigned int count;
+
+  if (argc < 2)
+    return def;
+
+  count = strtoul (argv[1], NULL, 10);
+  return count ? count : def;
+}
+
+char *
+bench_get_fixture (const char *name)
+{
+  const char *dir = g_getenv ("G_TEST_SRCDIR");
+
+  return g_build_filename (dir ? dir : ".", "fixtures", name, NULL);
+}
+
+static int
+bench_cmp (const void *a, const void *b)
+{
+  double va = *(const double *) a, vb = *(const double *) b;
+
+  return va < vb ? -1 : va > vb;
+}
+
+void
+bench_report (const char *name, double *samples, unsigned int count,
+    const char *unit)
+{
+  if (!count) {
+    printf ("%-16s no sample\n", name);
+    return;
+  }
+
+  /* Print percentiles as the runtime statistics */
+  qsort (samples, count, sizeof (*samples), bench_cmp);
+  printf ("%-16s n=%u p50=%.3f p90=%.3f p99=%.3f max=%.3f %s\n", name, count,
+      samples[count * 50 / 100], samples[count * 90 / 100],
+      samples[count * 99 / 100], samples[count - 1], unit);
+}
+
+void
+bench_report_phase (MeloWebplayerStatsPhase phase)
+{
+  gint64 durations[128];
+  double samples[128];
+  unsigned int i, count;
+
+  /* Get last samples of phase (in ms) */
+  count = melo_webplayer_stats_get_samples (
+      phase, durations, G_N_ELEMENTS (durations));
+  for (i = 0; i < count; i++)
+    samples[i] = durations[i] / 1000.0;
+
+  bench_report (melo_webplayer_stats_get_name (phase), samples, count, "ms");
+}
+
+static void
+bench_server_file_free (gpointer data)
+{
+  BenchServerFile *file = data;
+
+  g_bytes_unref (file->data);
+  g_free (file->type);
+  g_free (file);
+}
+
+static void
+bench_server_cb (SoupServer *server, SoupMessage *msg, const char *path,
+    GHashTable *query, SoupClientContext *client, gpointer user_data)
+{
+  BenchServer *bench = user_data;
+  BenchServerFile *file;
+  GBytes *data = NULL;
+  char *type = NULL;
+
+  /* Find file */
+  g_mutex_lock (&bench->mutex);
+  file = g_hash_table_lookup (bench->files, path);
+  if (file) {
+    data = g_bytes_ref (file->data);
+    type = g_strdup (file->type);
+  }
+  g_mutex_unlock (&bench->mutex);
+
+  if (!data) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+
+  /* Send file */
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_set_response (msg, type, SOUP_MEMORY_COPY,
+      g_bytes_get_data (data, NULL), g_bytes_get_size (data));
+  g_bytes_unref (data);
+  g_free (type);
+}
+
+static gpointer
+bench_server_thread_func (gpointer user_data)
+{
+  BenchServer *bench = user_data;
+  GError *error = NULL;
+  GSList *uris;
+
+  /* Server sources are attached to the thread default context */
+  g_main_context_push_thread_default (bench->context);
+
+  /* Listen on loopback interface */
+  bench->server = soup_server_new (NULL, NULL);
+  soup_server_add_handler (bench->server, NULL, bench_server_cb, bench, NULL);
+  if (soup_server_listen_local (
+          bench->server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error)) {
+    uris = soup_server_get_uris (bench->server);
+    bench->url = g_strdup_printf (
+        "http://127.0.0.1:%u", uris ? soup_uri_get_port (uris->data) : 0);
+    g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+  } else {
+    g_printerr ("failed to start HTTP server: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  /* Server is ready */
+  g_mutex_lock (&bench->mutex);
+  bench->ready = true;
+  g_cond_signal (&bench->cond);
+  g_mutex_unlock (&bench->mutex);
+
+  /* Serve requests */
+  if (bench->url)
+    g_main_loop_run (bench->loop);
+
+  g_object_unref (bench->server);
+  g_main_context_pop_thread_default (bench->context);
+
+  return NULL;
+}
+
+BenchServer *
+bench_server_new (void)
+{
+  BenchServer *bench;
+
+  bench = g_new0 (BenchServer, 1);
+  g_mutex_init (&bench->mutex);
+  g_cond_init (&bench->cond);
+  bench->files = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, bench_server_file_free);
+  bench->context = g_main_context_new ();
+  bench->loop = g_main_loop_new (bench->context, FALSE);
+
+  /* Start server thread and wait it listens */
+  bench->thread =
+      g_thread_new ("bench_server", bench_server_thread_func, bench);
+  g_mutex_lock (&bench->mutex);
+  while (!bench->ready)
+    g_cond_wait (&bench->cond, &bench->mutex);
+  g_mutex_unlock (&bench->mutex);
+
+  if (!bench->url) {
+    bench_server_free (bench);
+    return NULL;
+  }
+
+  return bench;
+}
+
+void
+bench_server_free (BenchServer *bench)
+{
+  if (!bench)
+    return;
+
+  /* Stop server thread */
+  g_main_loop_quit (bench->loop);
+  g_thread_join (bench->thread);
+
+  g_main_loop_unref (bench->loop);
+  g_main_context_unref (bench->context);
+  g_hash_table_unref (bench->files);
+  g_cond_clear (&bench->cond);
+  g_mutex_clear (&bench->mutex);
+  g_free (bench->url);
+  g_free (bench);
+}
+
+void
+bench_server_add (BenchServer *bench, const char *path, const char *fixture,
+    const char *type)
+{
+  char *filename;
+
+  /* Load fixture */
+  filename = bench_get_fixture (fixture);
+  bench_server_add_file (bench, path, filename, type);
+  g_free (filename);
+}
+
+void
+bench_server_add_file (BenchServer *bench, const char *path,
+    const char *filename, const char *type)
+{
+  BenchServerFile *file;
+  char *data;
+  gsize len;
+
+  /* Load file */
+  if (!g_file_get_contents (filename, &data, &len, NULL)) {
+    g_printerr ("failed to load %s\n", filename);
+    return;
+  }
+
+  /* Add file */
+  file = g_new0 (BenchServerFile, 1);
+  file->data = g_bytes_new_take (data, len);
+  file->type = g_strdup (type);
+  g_mutex_lock (&bench->mutex);
+  g_hash_table_replace (bench->files, g_strdup (path), file);
+  g_mutex_unlock (&bench->mutex);
+}
+
+const char *
+bench_server_get_url (BenchServer *bench)
+{
+  return bench->url;
+}
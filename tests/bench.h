@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <glib.h>
+
+#include "melo_webplayer_stats.h"
+
+G_BEGIN_DECLS
+
+typedef struct _BenchServer BenchServer;
+
+/**
+ * Get the number of iterations of a benchmark.
+ *
+ * The count is read from the first argument of the command line.
+ *
+ * @param argc the argument count
+ * @param argv the argument vector
+ * @param def the default count
+ * @return the number of iterations.
+ */
+unsigned int bench_get_iterations (int argc, char *argv[], unsigned int def);
+
+/**
+ * Get the path of a fixture file.
+ *
+ * @param name the fixture name
+ * @return a newly-allocated string with the path of the fixture.
+ */
+char *bench_get_fixture (const char *name);
+
+/**
+ * Print percentiles of samples.
+ *
+ * @param name the measure name
+ * @param samples the samples, sorted on return
+ * @param count the number of samples
+ * @param unit the unit of samples
+ */
+void bench_report (const char *name, double *samples, unsigned int count,
+    const char *unit);
+
+/**
+ * Print percentiles of a play path phase, from the runtime statistics.
+ *
+ * @param phase the phase
+ */
+void bench_report_phase (MeloWebplayerStatsPhase phase);
+
+/**
+ * Start a local HTTP server serving fixture files.
+ *
+ * The server runs in its own thread and listens on the loopback interface.
+ *
+ * @return the newly HTTP server.
+ */
+BenchServer *bench_server_new (void);
+void bench_server_free (BenchServer *bench);
+
+/**
+ * Serve a fixture file.
+ *
+ * @param bench the HTTP server
+ * @param path the URL path
+ * @param fixture the fixture name
+ * @param type the content type
+ */
+void bench_server_add (BenchServer *bench, const char *path,
+    const char *fixture, const char *type);
+
+/**
+ * Serve a file.
+ *
+ * @param bench the HTTP server
+ * @param path the URL path
+ * @param filename the file path
+ * @param type the content type
+ */
+void bench_server_add_file (BenchServer *bench, const char *path,
+    const char *filename, const char *type);
+
+/**
+ * Get the server base URL, without trailing slash.
+ *
+ * @param bench the HTTP server
+ * @return the server URL.
+ */
+const char *bench_server_get_url (BenchServer *bench);
+
+G_END_DECLS
+
+#endif /* !_BENCH_H_ */
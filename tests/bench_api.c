@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <json-glib/json-glib.h>
+#include <zlib.h>
+
+#include "bench.h"
+
+/* Default number of parsed pages */
+#define BENCH_API_ITERATIONS 200
+
+typedef struct {
+  const char *name;
+  const char *fixture;
+} BenchApiCase;
+
+/* Search page of 25 videos, without and with the browser field mask */
+static const BenchApiCase bench_api_cases[] = {
+    {"full", "search_full.json"},
+    {"masked", "search_masked.json"},
+};
+
+static gsize
+bench_api_gzip_size (const char *data, gsize len)
+{
+  z_stream z = {0};
+  unsigned char *out;
+  gsize size = 0;
+
+  /* Compress as the API does for user agents accepting gzip */
+  if (deflateInit2 (&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+          Z_DEFAULT_STRATEGY) != Z_OK)
+    return 0;
+  out = g_malloc (deflateBound (&z, len));
+  z.next_in = (unsigned char *) data;
+  z.avail_in = len;
+  z.next_out = out;
+  z.avail_out = deflateBound (&z, len);
+  if (deflate (&z, Z_FINISH) == Z_STREAM_END)
+    size = z.total_out;
+  deflateEnd (&z);
+  g_free (out);
+
+  return size;
+}
+
+static unsigned int
+bench_api_parse (const char *data, gsize len)
+{
+  JsonParser *parser;
+  JsonArray *array;
+  unsigned int i, count = 0;
+  JsonObject *obj;
+
+  /* Parse response */
+  parser = json_parser_new ();
+  if (!json_parser_load_from_data (parser, data, len, NULL))
+    goto end;
+  obj = json_node_get_object (json_parser_get_root (parser));
+  array = obj ? json_object_get_array_member (obj, "items") : NULL;
+  if (!array)
+    goto end;
+
+  /* Get fields used by the browser */
+  for (i = 0; i < json_array_get_length (array); i++) {
+    JsonObject *item = json_array_get_object_element (array, i);
+    JsonObject *id, *snippet, *thumbs;
+
+    id = json_object_get_object_member (item, "id");
+    snippet = json_object_get_object_member (item, "snippet");
+    if (!id || !snippet || !json_object_has_member (id, "videoId") ||
+        !json_object_has_member (snippet, "title"))
+      continue;
+    thumbs = json_object_get_object_member (snippet, "thumbnails");
+    if (thumbs && json_object_has_member (thumbs, "medium"))
+      count++;
+  }
+
+end:
+  g_object_unref (parser);
+  return count;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int i, j, count, items = 0;
+  double *samples;
+  int ret = 0;
+
+  count = bench_get_iterations (argc, argv, BENCH_API_ITERATIONS);
+  samples = g_new (double, count);
+
+  printf ("api search page\n");
+  for (i = 0; i < G_N_ELEMENTS (bench_api_cases); i++) {
+    const BenchApiCase *c = &bench_api_cases[i];
+    char *path, *data, *name;
+    gsize len;
+
+    /* Load response */
+    path = bench_get_fixture (c->fixture);
+    if (!g_file_get_contents (path, &data, &len, NULL)) {
+      printf ("failed to load %s\n", path);
+      g_free (path);
+      ret = 1;
+      break;
+    }
+    g_free (path);
+
+    /* Report transferred bytes */
+    printf ("%-16s %zu bytes, %zu with gzip\n", c->name, len,
+        bench_api_gzip_size (data, len));
+
+    /* Parse response */
+    for (j = 0; j < count; j++) {
+      gint64 start = g_get_monotonic_time ();
+
+      items = bench_api_parse (data, len);
+      samples[j] = (g_get_monotonic_time () - start) / 1000.0;
+    }
+    name = g_strconcat (c->name, "-parse", NULL);
+    bench_report (name, samples, count, "ms");
+    g_free (name);
+    g_free (data);
+
+    /* Both responses must carry the same videos */
+    if (items != 25) {
+      printf ("%s: %u videos found\n", c->name, items);
+      ret = 1;
+      break;
+    }
+  }
+  g_free (samples);
+
+  return ret;
+}
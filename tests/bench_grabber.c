@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "melo_webplayer_grabber.h"
+
+/* Default number of resolutions */
+#define BENCH_GRABBER_ITERATIONS 100
+/* Default number of workers */
+#define BENCH_GRABBER_WORKERS 1
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  bool done;
+  MeloWebplayerStream *stream;
+} BenchGrabberResult;
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  unsigned int pending;
+  unsigned int failed;
+} BenchGrabberBatch;
+
+static void
+bench_grabber_resolve_cb (MeloWebplayerStream *stream, void *user_data)
+{
+  BenchGrabberResult *result = user_data;
+
+  g_mutex_lock (&result->mutex);
+  result->stream = stream;
+  result->done = true;
+  g_cond_signal (&result->cond);
+  g_mutex_unlock (&result->mutex);
+}
+
+static void
+bench_grabber_batch_cb (MeloWebplayerStream *stream, void *user_data)
+{
+  BenchGrabberBatch *batch = user_data;
+
+  g_mutex_lock (&batch->mutex);
+  if (!stream)
+    batch->failed++;
+  if (!--batch->pending)
+    g_cond_signal (&batch->cond);
+  g_mutex_unlock (&batch->mutex);
+
+  melo_webplayer_stream_free (stream);
+}
+
+static void
+bench_grabber_request (MeloWebplayerGrabber *grabber, unsigned int index,
+    MeloWebplayerGrabberPriority priority, MeloWebplayerGrabberCb cb,
+    void *user_data)
+{
+  char *id, *url;
+
+  /* Use a new media each time, as a user browsing search results */
+  id = g_strdup_printf ("bench%06u", index);
+  url = g_strconcat ("https://www.youtube.com/watch?v=", id, NULL);
+  melo_webplayer_grabber_resolve (grabber, url, id, priority, cb, user_data);
+  g_free (url);
+  g_free (id);
+}
+
+static MeloWebplayerStream *
+bench_grabber_resolve (MeloWebplayerGrabber *grabber, unsigned int index)
+{
+  BenchGrabberResult result = {0};
+
+  g_mutex_init (&result.mutex);
+  g_cond_init (&result.cond);
+
+  bench_grabber_request (grabber, index, MELO_WEBPLAYER_GRABBER_PRIORITY_PLAY,
+      bench_grabber_resolve_cb, &result);
+
+  /* Wait result */
+  g_mutex_lock (&result.mutex);
+  while (!result.done)
+    g_cond_wait (&result.cond, &result.mutex);
+  g_mutex_unlock (&result.mutex);
+
+  g_cond_clear (&result.cond);
+  g_mutex_clear (&result.mutex);
+
+  return result.stream;
+}
+
+static unsigned int
+bench_grabber_run_batch (MeloWebplayerGrabber *grabber, unsigned int count)
+{
+  BenchGrabberBatch batch = {0};
+  unsigned int i;
+  gint64 start;
+
+  g_mutex_init (&batch.mutex);
+  g_cond_init (&batch.cond);
+
+  /* Queue all requests at once: play requests would replace each other */
+  start = g_get_monotonic_time ();
+  batch.pending = count;
+  for (i = 0; i < count; i++)
+    bench_grabber_request (grabber, count + i,
+        MELO_WEBPLAYER_GRABBER_PRIORITY_NEXT, bench_grabber_batch_cb, &batch);
+
+  /* Wait all results */
+  g_mutex_lock (&batch.mutex);
+  while (batch.pending)
+    g_cond_wait (&batch.cond, &batch.mutex);
+  g_mutex_unlock (&batch.mutex);
+
+  printf ("%-16s %.1f resolutions/s\n", "throughput",
+      count * (double) G_USEC_PER_SEC / (g_get_monotonic_time () - start));
+
+  g_cond_clear (&batch.cond);
+  g_mutex_clear (&batch.mutex);
+
+  return batch.failed;
+}
+
+int
+main (int argc, char *argv[])
+{
+  MeloWebplayerGrabber *grabber;
+  BenchServer *server;
+  unsigned int i, count, workers, failed = 0;
+  double *samples, *rss;
+  const char *profile;
+  char *path;
+
+  count = bench_get_iterations (argc, argv, BENCH_GRABBER_ITERATIONS);
+  workers = argc > 2 ? strtoul (argv[2], NULL, 10) : BENCH_GRABBER_WORKERS;
+
+  /* Serve video info recorded from yt-dlp */
+  server = bench_server_new ();
+  if (!server)
+    return 1;
+  bench_server_add (
+      server, "/info", "formats_video.json", "application/json");
+  g_setenv ("MELO_BENCH_URL", bench_server_get_url (server), TRUE);
+
+  /* Extraction profile: "lean" or "full", build default otherwise */
+  profile = g_getenv ("MELO_BENCH_PROFILE");
+
+  /* Load fake grabber module and wait end of self-check */
+  path = bench_get_fixture ("grabber");
+  grabber = melo_webplayer_grabber_new (path, NULL, NULL, workers);
+  if (profile)
+    melo_webplayer_grabber_set_lean (grabber, strcmp (profile, "full"));
+  melo_webplayer_grabber_load (grabber);
+  melo_webplayer_grabber_wait (grabber);
+  g_free (path);
+
+  /* Keep one-time phases: Python is initialized and module imported */
+  printf ("grabber load\n");
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_PY_INIT);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_IMPORT);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_INSTANTIATE);
+  melo_webplayer_stats_reset ();
+
+  /* Resolve streams one by one */
+  samples = g_new (double, count);
+  rss = g_new (double, count);
+  for (i = 0; i < count; i++) {
+    unsigned int size = melo_webplayer_stats_get_rss ();
+    gint64 start = g_get_monotonic_time ();
+    MeloWebplayerStream *stream;
+
+    stream = bench_grabber_resolve (grabber, i);
+    samples[i] = (g_get_monotonic_time () - start) / 1000.0;
+    rss[i] = (int) melo_webplayer_stats_get_rss () - (int) size;
+    if (!stream)
+      failed++;
+    melo_webplayer_stream_free (stream);
+  }
+
+  /* Report end-to-end time and its phases: queue wait is the dispatch latency
+   * to an idle worker. The RSS delta is the memory kept by each extraction,
+   * as seen by the process.
+   */
+  printf ("grabber resolve (%s profile, %u failed)\n",
+      profile ? profile : "default", failed);
+  bench_report ("resolve", samples, count, "ms");
+  bench_report ("rss delta", rss, count, "KiB");
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_QUEUE_WAIT);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_EXTRACT);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_SELECT);
+  g_free (rss);
+  g_free (samples);
+  melo_webplayer_stats_reset ();
+
+  /* Resolve streams concurrently: jobs wait for a free worker */
+  printf ("grabber batch (%u workers)\n", workers);
+  failed += bench_grabber_run_batch (grabber, count);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_QUEUE_WAIT);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_EXTRACT);
+
+  melo_webplayer_grabber_free (grabber);
+  bench_server_free (server);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "bench.h"
+#include "melo_webplayer_grabber.h"
+
+/* Default number of imports per mode */
+#define BENCH_IMPORT_ITERATIONS 10
+/* Number of generated extractor modules, as in a grabber release */
+#define BENCH_IMPORT_MODULES 400
+
+/* Extractor module template: only its compilation cost matters */
+static const char bench_import_template[] =
+    "import re\n"
+    "\n"
+    "_VALID_URL = re.compile(\n"
+    "    r'https?://(?:www\\.)?site%1$u\\.example/(?P<id>[0-9a-z]+)')\n"
+    "\n"
+    "\n"
+    "class Site%1$uIE:\n"
+    "    IE_NAME = 'site%1$u'\n"
+    "    _TESTS = [{'url': 'https://site%1$u.example/abc', 'id': 'abc'}]\n"
+    "\n"
+    "    @classmethod\n"
+    "    def suitable(cls, url):\n"
+    "        return _VALID_URL.match(url) is not None\n"
+    "\n"
+    "    def _real_extract(self, url):\n"
+    "        video_id = _VALID_URL.match(url).group('id')\n"
+    "        formats = []\n"
+    "        for i, ext in enumerate(('mp4', 'webm', 'm4a')):\n"
+    "            formats.append({\n"
+    "                'format_id': '%%s-%%d' %% (ext, i),\n"
+    "                'url': 'https://cdn.site%1$u.example/%%s.%%s' %% (\n"
+    "                    video_id, ext),\n"
+    "                'ext': ext,\n"
+    "            })\n"
+    "        return {'id': video_id, 'formats': formats}\n";
+
+static bool
+bench_import_write (const char *dir, const char *name, const char *data)
+{
+  char *path = g_build_filename (dir, name, NULL);
+  bool ret;
+
+  ret = g_file_set_contents (path, data, -1, NULL);
+  g_free (path);
+
+  return ret;
+}
+
+static char *
+bench_import_create_grabber (void)
+{
+  char *tmp, *pkg, *ie, *data, *init;
+  GString *imports;
+  unsigned int i;
+  bool ret;
+
+  /* Create grabber tree */
+  tmp = g_dir_make_tmp ("melo-bench-XXXXXX", NULL);
+  if (!tmp)
+    return NULL;
+  pkg = g_build_filename (tmp, "output", "yt_dlp", NULL);
+  ie = g_build_filename (pkg, "extractor", NULL);
+  g_mkdir_with_parents (ie, 0700);
+
+  /* Generate extractor modules */
+  imports = g_string_new (NULL);
+  for (i = 0; i < BENCH_IMPORT_MODULES; i++) {
+    char *name = g_strdup_printf ("site%u.py", i);
+
+    data = g_strdup_printf (bench_import_template, i);
+    bench_import_write (ie, name, data);
+    g_string_append_printf (imports, "from .site%u import Site%uIE\n", i, i);
+    g_free (data);
+    g_free (name);
+  }
+  ret = bench_import_write (ie, "__init__.py", imports->str);
+  g_string_free (imports, TRUE);
+
+  /* Use fake grabber module which imports all extractors */
+  data = bench_get_fixture ("grabber/output/yt_dlp/__init__.py");
+  if (ret && g_file_get_contents (data, &init, NULL, NULL)) {
+    char *mod = g_strconcat (init, "\nfrom . import extractor  # noqa\n", NULL);
+
+    ret = bench_import_write (pkg, "__init__.py", mod);
+    g_free (init);
+    g_free (mod);
+  } else
+    ret = false;
+  g_free (data);
+  g_free (ie);
+  g_free (pkg);
+
+  if (!ret) {
+    g_printerr ("failed to create grabber tree in %s\n", tmp);
+    g_free (tmp);
+    return NULL;
+  }
+
+  return tmp;
+}
+
+static int
+bench_import_remove (const char *path)
+{
+  GDir *dir;
+
+  /* Remove directory content */
+  dir = g_dir_open (path, 0, NULL);
+  if (dir) {
+    const char *name;
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+      char *child = g_build_filename (path, name, NULL);
+
+      bench_import_remove (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+  }
+
+  return g_remove (path);
+}
+
+static int
+bench_import_child (const char *mode, const char *path, const char *cache)
+{
+  MeloWebplayerGrabber *grabber;
+  gint64 sample, start;
+
+  /* Read-only grabber tree: module is compiled on each import */
+  if (!strcmp (mode, "source"))
+    g_setenv ("PYTHONDONTWRITEBYTECODE", "1", TRUE);
+
+  /* Compile or import module */
+  grabber = melo_webplayer_grabber_new (
+      path, strcmp (mode, "source") ? cache : NULL, NULL, 1);
+  start = g_get_monotonic_time ();
+  if (!strcmp (mode, "compile"))
+    melo_webplayer_grabber_compile (grabber);
+  else
+    melo_webplayer_grabber_load (grabber);
+  melo_webplayer_grabber_wait (grabber);
+
+  /* Get duration */
+  if (strcmp (mode, "compile")) {
+    if (!melo_webplayer_stats_get_samples (
+            MELO_WEBPLAYER_STATS_PHASE_IMPORT, &sample, 1))
+      sample = -1;
+  } else
+    sample = g_get_monotonic_time () - start;
+  melo_webplayer_grabber_free (grabber);
+
+  /* Send it to parent on last line (in us) */
+  printf ("%" G_GINT64_FORMAT "\n", sample);
+
+  return sample < 0;
+}
+
+static bool
+bench_import_spawn (const char *program, const char *mode, const char *path,
+    const char *cache, double *sample)
+{
+  char *argv[] = {(char *) program, "--child", (char *) mode, (char *) path,
+      (char *) cache, NULL};
+  char *out = NULL, *line;
+  int status;
+  bool ret;
+
+  /* Run import in a new process: Python is initialized once per process */
+  ret = g_spawn_sync (NULL, argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, &out,
+            NULL, &status, NULL) &&
+        g_spawn_check_exit_status (status, NULL);
+  if (ret) {
+    line = strrchr (g_strchomp (out), '\n');
+    *sample = g_ascii_strtoll (line ? line + 1 : out, NULL, 10) / 1000.0;
+  }
+  g_free (out);
+
+  return ret;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const char *modes[] = {"source", "bytecode"};
+  unsigned int i, j, count;
+  char *tmp, *cache;
+  BenchServer *server;
+  double *samples;
+  int ret = 0;
+
+  if (argc == 5 && !strcmp (argv[1], "--child"))
+    return bench_import_child (argv[2], argv[3], argv[4]);
+  count = bench_get_iterations (argc, argv, BENCH_IMPORT_ITERATIONS);
+
+  /* Serve video info for self-check of loaded module */
+  server = bench_server_new ();
+  if (!server)
+    return 1;
+  bench_server_add (
+      server, "/info", "formats_video.json", "application/json");
+  g_setenv ("MELO_BENCH_URL", bench_server_get_url (server), TRUE);
+
+  /* Generate a grabber tree */
+  tmp = bench_import_create_grabber ();
+  if (!tmp) {
+    bench_server_free (server);
+    return 1;
+  }
+  cache = g_build_filename (tmp, "cache", NULL);
+  samples = g_new (double, count);
+
+  /* Compile module to bytecode cache, as after an update */
+  printf ("grabber compile (%u modules)\n", BENCH_IMPORT_MODULES);
+  if (bench_import_spawn (argv[0], "compile", tmp, cache, samples))
+    bench_report ("compile", samples, 1, "ms");
+  else
+    ret = 1;
+
+  /* Import module from sources, then from bytecode cache */
+  printf ("grabber import\n");
+  for (i = 0; i < G_N_ELEMENTS (modes) && !ret; i++) {
+    for (j = 0; j < count && !ret; j++)
+      if (!bench_import_spawn (argv[0], modes[i], tmp, cache, &samples[j]))
+        ret = 1;
+    if (!ret)
+      bench_report (modes[i], samples, count, "ms");
+  }
+  if (ret)
+    printf ("import failed\n");
+
+  bench_import_remove (tmp);
+  bench_server_free (server);
+  g_free (samples);
+  g_free (cache);
+  g_free (tmp);
+
+  return ret;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "bench.h"
+
+/* Default number of playbacks per source */
+#define BENCH_PLAY_ITERATIONS 50
+/* Length of generated audio stream (in buffers of 10 ms) */
+#define BENCH_PLAY_BUFFERS 1000
+/* Maximum time to pre-roll a stream (in s) */
+#define BENCH_PLAY_TIMEOUT 10
+
+/* Generated stream: Opus in WebM as most YouTube audio formats, or WAV */
+static const char *bench_play_encoders[][2] = {
+    {"opusenc ! webmmux", "audio/webm"},
+    {"wavenc", "audio/x-wav"},
+};
+
+typedef struct {
+  GstElement *pipeline;
+  GstElement *src;
+  GstElement *sink;
+  gint64 start;
+  gint first_audio;
+} BenchPlay;
+
+static char *
+bench_play_create_stream (const char *dir, const char **type)
+{
+  unsigned int i;
+
+  /* Encode a tone with the first available encoder */
+  for (i = 0; i < G_N_ELEMENTS (bench_play_encoders); i++) {
+    GstElement *pipeline;
+    GstMessage *msg;
+    char *desc, *path;
+    bool ret;
+
+    path = g_build_filename (dir, "stream", NULL);
+    desc = g_strdup_printf ("audiotestsrc num-buffers=%u samplesperbuffer=480 "
+                            "! audio/x-raw,rate=48000 ! audioconvert ! %s ! "
+                            "filesink location=\"%s\"",
+        BENCH_PLAY_BUFFERS, bench_play_encoders[i][0], path);
+    pipeline = gst_parse_launch (desc, NULL);
+    g_free (desc);
+    if (!pipeline) {
+      g_free (path);
+      continue;
+    }
+
+    /* Wait end of encoding */
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+    msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline),
+        GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    ret = msg && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+    if (msg)
+      gst_message_unref (msg);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (pipeline);
+
+    if (ret) {
+      *type = bench_play_encoders[i][1];
+      return path;
+    }
+    g_free (path);
+  }
+
+  return NULL;
+}
+
+static gint
+bench_play_select_stream_cb (GstElement *src, GstStreamCollection *collection,
+    GstStream *stream, gpointer user_data)
+{
+  return gst_stream_get_stream_type (stream) & GST_STREAM_TYPE_AUDIO ? -1 : 0;
+}
+
+static void
+bench_play_pad_added_cb (GstElement *src, GstPad *pad, GstElement *sink)
+{
+  GstPad *sink_pad;
+
+  /* Link first audio pad */
+  sink_pad = gst_element_get_static_pad (sink, "sink");
+  if (!GST_PAD_IS_LINKED (sink_pad))
+    gst_pad_link (pad, sink_pad);
+  gst_object_unref (sink_pad);
+}
+
+static GstPadProbeReturn
+bench_play_first_audio_probe_cb (
+    GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  BenchPlay *play = user_data;
+
+  if (g_atomic_int_compare_and_exchange (&play->first_audio, 1, 0))
+    melo_webplayer_stats_add (
+        MELO_WEBPLAYER_STATS_PHASE_FIRST_AUDIO, play->start);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static bool
+bench_play_init (BenchPlay *play)
+{
+  bool gapless = true;
+  GstCaps *caps;
+  GstPad *pad;
+
+  /* Same pipeline as the player, with a clocked fake sink */
+  play->pipeline = gst_pipeline_new ("bench_play");
+  play->src = gst_element_factory_make ("uridecodebin3", NULL);
+  if (!play->src) {
+    play->src = gst_element_factory_make ("uridecodebin", NULL);
+    gapless = false;
+  }
+  play->sink = gst_element_factory_make ("fakesink", NULL);
+  if (!play->src || !play->sink) {
+    g_printerr ("failed to create pipeline\n");
+    return false;
+  }
+  g_object_set (play->sink, "sync", TRUE, NULL);
+  gst_bin_add_many (GST_BIN (play->pipeline), play->src, play->sink, NULL);
+
+  /* Handle only audio tracks */
+  caps = gst_caps_from_string ("audio/x-raw(ANY)");
+  if (gapless) {
+    g_object_set (play->src, "caps", caps, NULL);
+    g_signal_connect (play->src, "select-stream",
+        G_CALLBACK (bench_play_select_stream_cb), NULL);
+  } else
+    g_object_set (play->src, "caps", caps, "expose-all-streams", FALSE, NULL);
+  gst_caps_unref (caps);
+  g_signal_connect (play->src, "pad-added",
+      G_CALLBACK (bench_play_pad_added_cb), play->sink);
+
+  /* Measure time to first audio */
+  pad = gst_element_get_static_pad (play->sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      bench_play_first_audio_probe_cb, play, NULL);
+  gst_object_unref (pad);
+
+  return true;
+}
+
+static bool
+bench_play_run (BenchPlay *play, const char *uri)
+{
+  GstMessage *msg;
+  bool ret;
+
+  /* Start playing as the player */
+  g_object_set (play->src, "uri", uri, NULL);
+  play->start = g_get_monotonic_time ();
+  g_atomic_int_set (&play->first_audio, 1);
+  gst_element_set_state (play->pipeline, GST_STATE_PLAYING);
+
+  /* Wait end of pre-roll */
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (play->pipeline),
+      BENCH_PLAY_TIMEOUT * GST_SECOND,
+      GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR);
+  ret = msg && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE;
+  if (ret)
+    melo_webplayer_stats_add (MELO_WEBPLAYER_STATS_PHASE_PREROLL, play->start);
+  if (msg)
+    gst_message_unref (msg);
+
+  /* Stop and flush bus for next playback */
+  gst_element_set_state (play->pipeline, GST_STATE_NULL);
+  gst_bus_set_flushing (GST_ELEMENT_BUS (play->pipeline), TRUE);
+  gst_bus_set_flushing (GST_ELEMENT_BUS (play->pipeline), FALSE);
+
+  return ret;
+}
+
+static unsigned int
+bench_play_run_all (BenchPlay *play, const char *name, const char *uri,
+    unsigned int count)
+{
+  unsigned int i, failed = 0;
+
+  melo_webplayer_stats_reset ();
+  for (i = 0; i < count; i++)
+    if (!bench_play_run (play, uri))
+      failed++;
+
+  /* Report pre-roll and time to first buffer at sink */
+  printf ("play %s (%u failed)\n", name, failed);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_PREROLL);
+  bench_report_phase (MELO_WEBPLAYER_STATS_PHASE_FIRST_AUDIO);
+
+  return failed;
+}
+
+int
+main (int argc, char *argv[])
+{
+  BenchPlay play = {0};
+  BenchServer *server;
+  unsigned int count, failed = 0;
+  const char *type;
+  char *tmp, *path, *uri;
+
+  gst_init (&argc, &argv);
+  count = bench_get_iterations (argc, argv, BENCH_PLAY_ITERATIONS);
+
+  /* Generate audio stream */
+  tmp = g_dir_make_tmp ("melo-bench-XXXXXX", NULL);
+  path = tmp ? bench_play_create_stream (tmp, &type) : NULL;
+  if (!path) {
+    g_printerr ("failed to generate audio stream\n");
+    return 1;
+  }
+
+  /* Serve stream as a remote audio format */
+  server = bench_server_new ();
+  if (!server || !bench_play_init (&play))
+    return 1;
+  bench_server_add_file (server, "/stream", path, type);
+
+  /* Stream from audio cache */
+  uri = g_filename_to_uri (path, NULL, NULL);
+  failed += bench_play_run_all (&play, "local", uri, count);
+  g_free (uri);
+
+  /* Stream from network */
+  uri = g_strconcat (bench_server_get_url (server), "/stream", NULL);
+  failed += bench_play_run_all (&play, "http", uri, count);
+  g_free (uri);
+
+  gst_object_unref (play.pipeline);
+  bench_server_free (server);
+  g_unlink (path);
+  g_rmdir (tmp);
+  g_free (path);
+  g_free (tmp);
+
+  return failed ? 1 : 0;
+}
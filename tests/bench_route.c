@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "melo_webplayer_route.h"
+
+/* Default number of samples */
+#define BENCH_ROUTE_ITERATIONS 200
+/* Number of lookups per sample */
+#define BENCH_ROUTE_LOOKUPS 10000
+
+typedef struct {
+  const char *name;
+  const char *url;
+} BenchRouteCase;
+
+/* URLs are from the browser and playlists, the last ones are not routed */
+static const BenchRouteCase bench_route_cases[] = {
+    {"youtube", "https://www.youtube.com/watch?v=dQw4w9WgXcQ"},
+    {"youtube-short", "https://youtu.be/dQw4w9WgXcQ"},
+    {"youtube-music", "https://music.youtube.com/watch?v=dQw4w9WgXcQ"},
+    {"dailymotion", "https://www.dailymotion.com/video/x7tgad0"},
+    {"unknown-host", "https://vimeo.com/76979871"},
+    {"unknown-path", "https://www.youtube.com/playlist?list=PL0123456789"},
+};
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int i, j, k, count;
+  double *samples;
+
+  count = bench_get_iterations (argc, argv, BENCH_ROUTE_ITERATIONS);
+  samples = g_new (double, count);
+
+  /* Measure lookup time of each URL */
+  printf ("route lookup\n");
+  for (i = 0; i < G_N_ELEMENTS (bench_route_cases); i++) {
+    const BenchRouteCase *c = &bench_route_cases[i];
+    const char *volatile ie_key = NULL;
+
+    for (j = 0; j < count; j++) {
+      gint64 start = g_get_monotonic_time ();
+
+      for (k = 0; k < BENCH_ROUTE_LOOKUPS; k++)
+        ie_key = melo_webplayer_route_find (c->url);
+      samples[j] = (g_get_monotonic_time () - start) * 1000.0 /
+                   BENCH_ROUTE_LOOKUPS;
+    }
+
+    bench_report (c->name, samples, count, "ns");
+    if ((ie_key == NULL) != g_str_has_prefix (c->name, "unknown")) {
+      printf ("%s: unexpected route\n", c->name);
+      return 1;
+    }
+  }
+  g_free (samples);
+
+  return 0;
+}
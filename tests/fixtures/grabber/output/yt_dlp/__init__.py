@@ -0,0 +1,62 @@
+# Fake grabber module used by benchmarks
+#
+# It implements the part of the yt_dlp API used by the grabber. Video info is
+# fetched from the benchmark HTTP server, so an extraction costs a local
+# request and a JSON parsing instead of a YouTube round-trip. Extractor CPU
+# work can be simulated with MELO_BENCH_CPU_MS, to compare worker counts.
+#
+# The extra work skipped by the lean profile is modeled too: each HLS / DASH
+# manifest which is not skipped and the format check cost one more request,
+# and manifest formats are added to the video info.
+
+import json
+import os
+import time
+import urllib.request
+
+__version__ = "bench"
+
+
+def _burn(ms):
+    end = time.thread_time() + ms / 1000
+    while time.thread_time() < end:
+        pass
+
+
+class _Extractor:
+    def suitable(self, url):
+        return "youtube.com/" in url
+
+
+class _CookieJar:
+    def save(self):
+        pass
+
+
+class YoutubeDL:
+    def __init__(self, params=None):
+        self.params = dict(params or {})
+        self.cookiejar = _CookieJar()
+
+    def get_info_extractor(self, ie_key):
+        return _Extractor()
+
+    def _fetch(self):
+        base = os.environ["MELO_BENCH_URL"]
+        with urllib.request.urlopen(base + "/info", timeout=10) as rep:
+            return json.load(rep)
+
+    def extract_info(self, url, download=True, ie_key=None, process=True,
+                     **kwargs):
+        info = self._fetch()
+        args = self.params.get("extractor_args", {}).get("youtube", {})
+        for manifest in ("hls", "dash"):
+            if manifest not in args.get("skip", []):
+                info["formats"] += self._fetch().get("formats", [])
+        if self.params.get("check_formats") is not False:
+            self._fetch()
+        info["webpage_url"] = url
+        _burn(float(os.environ.get("MELO_BENCH_CPU_MS", "0")))
+        if not process:
+            info.pop("formats", None)
+        return info
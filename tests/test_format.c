@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+
+#include <string.h>
+
+#include <json-glib/json-glib.h>
+
+#include "melo_webplayer_format.h"
+
+typedef struct {
+  const char *name;
+  const char *fixture;
+  const char *preferred_codec;
+  unsigned int max_bitrate;
+  unsigned int cost_weight;
+  bool ban_video;
+  const char *expected;
+} TestFormatCase;
+
+/* Format lists are recorded from yt-dlp and trimmed to the fields used */
+static const TestFormatCase test_format_cases[] = {
+    {"video/previous", "formats_video.json", NULL, 0, 0, false, "251"},
+    {"video/opus", "formats_video.json", "opus", 0, 0, false, "251"},
+    {"video/mp4a", "formats_video.json", "mp4a", 0, 0, false, "140"},
+    {"video/max-bitrate", "formats_video.json", NULL, 64, 0, false, "250"},
+    {"video/cost", "formats_video.json", NULL, 0, 100, false, "140"},
+    {"video/ban-video", "formats_video.json", NULL, 0, 0, true, "251"},
+    {"live/previous", "formats_live.json", NULL, 0, 0, false, "95"},
+    {"live/opus", "formats_live.json", "opus", 0, 0, false, "95"},
+    {"live/ban-video", "formats_live.json", NULL, 0, 0, true, NULL},
+    {"nobitrate/mp4a", "formats_nobitrate.json", "mp4a", 0, 0, false, "18"},
+    {"nobitrate/ban-video", "formats_nobitrate.json", NULL, 0, 0, true, NULL},
+};
+
+static const char *
+test_format_get_string (JsonObject *obj, const char *key)
+{
+  JsonNode *node = json_object_get_member (obj, key);
+
+  if (!node || !JSON_NODE_HOLDS_VALUE (node) ||
+      json_node_get_value_type (node) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string (node);
+}
+
+static bool
+test_format_get_number (JsonObject *obj, const char *key, double *value)
+{
+  JsonNode *node = json_object_get_member (obj, key);
+
+  if (!node || !JSON_NODE_HOLDS_VALUE (node))
+    return false;
+
+  *value = json_node_get_double (node);
+  return true;
+}
+
+static void
+test_format_select (gconstpointer data)
+{
+  const TestFormatCase *c = data;
+  MeloWebplayerFormatPolicy policy = {
+      .codecs = melo_webplayer_format_get_default_policy ()->codecs,
+      .preferred_codec = c->preferred_codec,
+      .max_bitrate = c->max_bitrate,
+      .cost_weight = c->cost_weight,
+      .ban_video = c->ban_video,
+  };
+  MeloWebplayerFormat *fmts;
+  GError *error = NULL;
+  JsonParser *parser;
+  JsonArray *array;
+  unsigned int i, count;
+  char *path;
+  int best;
+
+  /* Load recorded format list */
+  path = g_test_build_filename (G_TEST_DIST, "fixtures", c->fixture, NULL);
+  parser = json_parser_new ();
+  json_parser_load_from_file (parser, path, &error);
+  g_assert_no_error (error);
+  g_free (path);
+  array = json_object_get_array_member (
+      json_node_get_object (json_parser_get_root (parser)), "formats");
+  g_assert_nonnull (array);
+
+  /* Convert formats as the grabber does */
+  count = json_array_get_length (array);
+  fmts = g_new0 (MeloWebplayerFormat, count);
+  for (i = 0; i < count; i++) {
+    JsonObject *obj = json_array_get_object_element (array, i);
+    MeloWebplayerFormat *f = &fmts[i];
+
+    f->url = test_format_get_string (obj, "url");
+    f->acodec = test_format_get_string (obj, "acodec");
+    f->vcodec = test_format_get_string (obj, "vcodec");
+    if (!test_format_get_number (obj, "abr", &f->bitrate))
+      test_format_get_number (obj, "tbr", &f->bitrate);
+  }
+
+  /* Check selected format */
+  best = melo_webplayer_format_select (&policy, fmts, count);
+  if (c->expected) {
+    g_assert_cmpint (best, >=, 0);
+    g_assert_cmpstr (test_format_get_string (
+                         json_array_get_object_element (array, best),
+                         "format_id"),
+        ==, c->expected);
+  } else
+    g_assert_cmpint (best, ==, -1);
+
+  g_free (fmts);
+  g_object_unref (parser);
+}
+
+static void
+test_format_video_last (void)
+{
+  static const MeloWebplayerFormat fmts[] = {
+      {"muxed", "mp4a.40.2", "avc1.640028", 4693.891},
+      {"audio", "mp4a.40.5", "none", 48.782},
+  };
+  MeloWebplayerFormatPolicy policy = {
+      .codecs = melo_webplayer_format_get_default_policy ()->codecs,
+      .preferred_codec = "mp4a",
+  };
+
+  /* A muxed format never wins against an audio-only format */
+  g_assert_cmpint (melo_webplayer_format_select (&policy, fmts, 2), ==, 1);
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (test_format_cases); i++) {
+    char *name = g_strconcat ("/format/select/", test_format_cases[i].name,
+        NULL);
+
+    g_test_add_data_func (name, &test_format_cases[i], test_format_select);
+    g_free (name);
+  }
+  g_test_add_func ("/format/video-last", test_format_video_last);
+
+  return g_test_run ();
+}